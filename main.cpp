@@ -2,539 +2,5814 @@
 #include <string>
 #include <iomanip>
 #include <limits>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <fstream>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <unordered_set>
+#include <cstring>
+#include <cstdio>
+#include <string_view>
+#include <type_traits>
+#include <chrono>
+#include <random>
+#include <charconv>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <strings.h>
 
 using namespace std;
 
 
-// Class representing an item in the inventory
+// Converts a price to whole cents so running totals are kept in exact integer arithmetic
+long long toCents(double price) {
+    return llround(price * 100);
+}
+
+// Formats an amount of cents with two decimals, e.g. 1999 -> 19.99 and -5 -> -0.05. Takes
+// 128 bits because stock values (quantity x price, summed) can exceed a long long.
+string formatCents(__int128 cents) {
+    unsigned __int128 magnitude = cents < 0 ? -(unsigned __int128) cents : cents;
+    string digits;  // Least significant first
+    while (magnitude > 0 || digits.size() < 3) {
+        digits.push_back('0' + (int) (magnitude % 10));
+        magnitude /= 10;
+    }
+    digits.insert(2, 1, '.');
+    if (cents < 0) digits.push_back('-');
+    return string(digits.rbegin(), digits.rend());
+}
+
+// Largest price accepted from outside; its cents fit in a long long (stock values are summed in 128 bits)
+constexpr double MAX_PRICE = 1e12;
+
+// Checks a price before it is stored or converted to cents: finite, not negative, not huge
+bool validPrice(double price) {
+    return isfinite(price) && price >= 0 && price <= MAX_PRICE;
+}
+
+// Parses a whole field as a price; false if it is not a number or not a valid price
+bool parsePrice(string_view text, double& price) {
+    auto result = from_chars(text.data(), text.data() + text.size(), price);
+    return result.ec == errc() && result.ptr == text.data() + text.size() && validPrice(price);
+}
+
+// Parses a whole field as a quantity; false if it is not a whole number, is negative or
+// does not fit in an int
+bool parseQuantity(string_view text, int& quantity) {
+    auto result = from_chars(text.data(), text.data() + text.size(), quantity);
+    return result.ec == errc() && result.ptr == text.data() + text.size() && quantity >= 0;
+}
+
+// Buffered reader for standard input, used instead of cin. It reads fd 0 in large blocks,
+// finds tokens in place as string_views and parses numbers with from_chars, so piped input
+// costs a few passes over a buffer rather than a stream extraction per character. It keeps
+// the parts of the cin interface the menus use: >> (a failed read sets the fail state, which
+// clear() resets), ignoreLine() and getline(). Reading a char takes the first character of
+// the next word.
+class InputReader {
+private:
+    static constexpr size_t BLOCK_SIZE = 1 << 16;
+
+    string buffer;
+    size_t pos = 0;
+    bool failed = false;
+    bool atEof = false;
+    unique_lock<mutex> *heldWhileIdle = nullptr;  // Released while waiting for input
+
+    // Reads the next block, keeping the unread tail; returns false at end of input
+    bool refill() {
+        if (atEof) return false;
+        cout.flush();  // Show the prompt before waiting, as cin's tie to cout did
+
+        buffer.erase(0, pos);
+        pos = 0;
+        size_t size = buffer.size();
+        buffer.resize(size + BLOCK_SIZE);
+        ssize_t n;
+        bool relock = heldWhileIdle != nullptr && heldWhileIdle->owns_lock();
+        if (relock) heldWhileIdle->unlock();
+        do {
+            n = read(0, buffer.data() + size, BLOCK_SIZE);
+        } while (n == -1 && errno == EINTR);
+        if (relock) heldWhileIdle->lock();
+        buffer.resize(size + max<ssize_t>(n, 0));
+
+        if (n <= 0) atEof = true;
+        return n > 0;
+    }
+
+    // Returns the next whitespace-separated word (empty at end of input). The view is valid
+    // until the next read.
+    string_view token() {
+        while (true) {
+            while (pos < buffer.size() && isspace((unsigned char) buffer[pos])) pos++;
+            if (pos < buffer.size() || !refill()) break;
+        }
+
+        // refill() drops what was already read, so a word cut by the end of a block stays in one piece
+        size_t length = 0;
+        while (true) {
+            while (pos + length < buffer.size() && !isspace((unsigned char) buffer[pos + length])) length++;
+            if (pos + length < buffer.size() || !refill()) break;
+        }
+
+        string_view word = string_view(buffer).substr(pos, length);
+        pos += length;
+        return word;
+    }
+
+    template<typename T>
+    bool parse(string_view word, T& value) {
+        if constexpr (is_same_v<T, string>) {
+            value.assign(word);
+            return true;
+        } else if constexpr (is_same_v<T, char>) {
+            value = word[0];
+            return true;
+        } else {
+            auto result = from_chars(word.data(), word.data() + word.size(), value);
+            return result.ec == errc() && result.ptr == word.data() + word.size();
+        }
+    }
+
+public:
+    // Lock the caller holds while it works with shared data. Whenever a read has to wait for
+    // more input, the lock is released until the input arrives, so other threads are never
+    // held up by a prompt (nullptr: no lock).
+    void releaseWhileWaiting(unique_lock<mutex>* lock) { heldWhileIdle = lock; }
+
+    template<typename T>
+    InputReader& operator>>(T& value) {
+        string_view word = failed ? string_view() : token();
+        if (word.empty() || !parse(word, value)) {
+            value = T();  // Like a failed stream extraction, leave a defined value behind
+            failed = true;
+        }
+        return *this;
+    }
+
+    explicit operator bool() const { return !failed; }
+    bool operator!() const { return failed; }
+    bool eof() const { return atEof && pos >= buffer.size(); }
+    void clear() { failed = false; }
+
+    // Skips the rest of the current line
+    void ignoreLine() {
+        while (true) {
+            size_t end = buffer.find('\n', pos);
+            if (end != string::npos) {
+                pos = end + 1;
+                return;
+            }
+            pos = buffer.size();
+            if (!refill()) return;
+        }
+    }
+
+    // Reads the rest of the current line; returns false at end of input
+    bool getline(string& line) {
+        line.clear();
+        while (true) {
+            size_t end = buffer.find('\n', pos);
+            if (end != string::npos) {
+                line.append(buffer, pos, end - pos);
+                pos = end + 1;
+                break;
+            }
+            line.append(buffer, pos, string::npos);
+            pos = buffer.size();
+            if (!refill()) {
+                if (line.empty()) return false;
+                break;
+            }
+        }
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        return true;
+    }
+};
+
+InputReader input;  // All interactive and piped input goes through here
+
+// Registry of the valid item categories, loaded from a configuration file at startup.
+// Names are looked up case-insensitively through a minimal perfect hash built with the
+// hash-and-displace scheme: each key's first hash picks a bucket, and every bucket stores the
+// seed that sends all of its keys to distinct slots. A lookup is therefore two hashes and one
+// comparison, however many categories are configured.
+class CategoryRegistry {
+private:
+    vector<string> names;          // Canonical (lowercase) names, indexed by category ID
+    vector<string> displayNames;   // Names as written in the configuration, for prompts
+    vector<uint32_t> seeds;        // Per-bucket displacement seed
+    vector<int> slots;             // Slot -> category ID (at least as many slots as names)
+
+    static constexpr uint32_t MAX_SEED_TRIES = 1 << 16;  // Per bucket, before the slot table grows
+
+    // FNV-1a over the ASCII-lowercased characters, mixed with a seed
+    static uint32_t hash(const string& key, uint32_t seed) {
+        uint32_t h = 2166136261u ^ (seed * 16777619u);
+        for (unsigned char c : key) {
+            if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+            h = (h ^ c) * 16777619u;
+        }
+        return h ^ (h >> 15);
+    }
+
+    static bool equalsIgnoreCase(const string& a, const string& b) {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); i++) {
+            if (tolower((unsigned char) a[i]) != tolower((unsigned char) b[i])) return false;
+        }
+        return true;
+    }
+
+    // Tries to place every bucket into a table of the given number of slots
+    bool placeBuckets(size_t slotCount) {
+        size_t n = names.size();
+        seeds.assign(n, 0);
+        slots.assign(slotCount, -1);
+
+        vector<vector<int>> buckets(n);
+        for (size_t id = 0; id < n; id++) {
+            buckets[hash(names[id], 0) % n].push_back(id);
+        }
+
+        // Place the largest buckets first while most slots are still free
+        vector<int> order(n);
+        for (size_t b = 0; b < n; b++) order[b] = b;
+        sort(order.begin(), order.end(), [&](int a, int b) { return buckets[a].size() > buckets[b].size(); });
+
+        for (int b : order) {
+            if (buckets[b].empty()) break;
+
+            bool placed = false;
+            for (uint32_t seed = 1; seed <= MAX_SEED_TRIES && !placed; seed++) {
+                vector<int> chosen;
+                for (int id : buckets[b]) {
+                    int slot = hash(names[id], seed) % slotCount;
+                    if (slots[slot] != -1 || std::find(chosen.begin(), chosen.end(), slot) != chosen.end()) break;
+                    chosen.push_back(slot);
+                }
+
+                if (chosen.size() == buckets[b].size()) {
+                    for (size_t k = 0; k < chosen.size(); k++) slots[chosen[k]] = buckets[b][k];
+                    seeds[b] = seed;
+                    placed = true;
+                }
+            }
+            if (!placed) return false;
+        }
+        return true;
+    }
+
+    // Builds the perfect hash over the current names, with more slots than names if the
+    // minimal table cannot be placed within the seed budget
+    void buildHash() {
+        size_t slotCount = names.size();
+        while (!placeBuckets(slotCount)) slotCount += slotCount / 4 + 1;
+    }
+
+    // Why a category name cannot be used, or an empty string if it can
+    static string invalidName(const string& name) {
+        if (name.size() > MAX_NAME_LENGTH) return "longer than " + to_string(MAX_NAME_LENGTH) + " characters";
+        for (unsigned char c : name) {
+            if (isspace(c)) return "contains whitespace";
+        }
+        if (name == "0" || equalsIgnoreCase(name, "all")) return "reserved for the menus";
+        return "";
+    }
+
+public:
+    static constexpr int MAX_CATEGORIES = 256;  // Category IDs are stored in one byte per item
+    static constexpr int MAX_NAME_LENGTH = 63;  // Fits the category table of an item file
+
+    // Loads one category name per line from the given file (at most MAX_CATEGORIES); falls
+    // back to the built-in categories if the file is missing or empty
+    void load(const string& path) {
+        names.clear();
+        displayNames.clear();
+
+        ifstream file(path);
+        string line;
+        while (getline(file, line)) {
+            line.erase(0, line.find_first_not_of(" \t\r"));
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (line.empty() || line[0] == '#') continue;  // Skip blank lines and comments
+
+            // Categories are typed as one word at the prompts, where "All" and "0" mean something else
+            string problem = invalidName(line);
+            if (!problem.empty()) {
+                cerr << "Skipping category '" << line << "' in " << path << ": " << problem << ".\n";
+                continue;
+            }
+
+            string canonical = line;
+            for (auto &c : canonical) c = tolower(c);
+            if (std::find(names.begin(), names.end(), canonical) != names.end()) continue;  // Duplicate
+            if ((int) names.size() >= MAX_CATEGORIES) break;
+
+            displayNames.push_back(line);
+            names.push_back(canonical);
+        }
+
+        if (names.empty()) {
+            displayNames = {"Clothing", "Electronics", "Entertainment"};
+            names = {"clothing", "electronics", "entertainment"};
+        }
+        buildHash();
+    }
+
+    // Returns the ID of the category with the given name (any letter case), or -1 if unknown
+    int find(const string& name) const {
+        if (names.empty()) return -1;
+
+        int id = slots[hash(name, seeds[hash(name, 0) % seeds.size()]) % slots.size()];
+        return (id != -1 && equalsIgnoreCase(names[id], name)) ? id : -1;
+    }
+
+    // Returns the ID of the category, registering it first if it is not configured (e.g. a
+    // stored item whose category was since removed from the configuration). Returns -1 if it
+    // cannot be registered: the registry is full or the name is not a valid category name.
+    int findOrAdd(const string& name) {
+        int id = find(name);
+        if (id != -1) return id;
+        if ((int) names.size() >= MAX_CATEGORIES || !invalidName(name).empty()) return -1;
+
+        string canonical = name;
+        for (auto &c : canonical) c = tolower(c);
+        displayNames.push_back(name);
+        names.push_back(canonical);
+        buildHash();
+        return names.size() - 1;
+    }
+
+    int size() const { return names.size(); }
+    const string& name(int id) const { return names[id]; }
+
+    // Comma-separated display names, e.g. for input prompts
+    string listNames() const {
+        string list;
+        for (size_t id = 0; id < displayNames.size(); id++) {
+            if (id > 0) list += ", ";
+            list += displayNames[id];
+        }
+        return list;
+    }
+};
+
+// The categories in effect for this run (loaded in main)
+CategoryRegistry categories;
+
+// Class representing an item in the inventory.
+// The record is a fixed 64 bytes with no heap pointers, so arrays of items are copied with
+// memcpy and can be written to disk as-is. Everything read by searches, sorts, reports and
+// stock updates sits in the first 32 bytes; the name follows as cold data.
 class Item {
+public:
+    static constexpr int MAX_ID_LENGTH = 15;
+    static constexpr int MAX_NAME_LENGTH = 31;
+
 private:
+    int64_t priceCents;              // Price in whole cents, so equal prices compare exactly
+    int32_t quantity;
+    uint8_t categoryId;              // Index into the category registry
+    char id[MAX_ID_LENGTH + 1];      // NUL-terminated, stored inline
+    char name[MAX_NAME_LENGTH + 1];  // NUL-terminated, stored inline
+
+    // Copies text into a fixed buffer. Text that does not fit is a bug in the caller (outside
+    // data goes through checkFields first): cutting it could turn two IDs into one.
+    template<size_t N>
+    static void copyText(char (&target)[N], string_view text) {
+        if (text.size() > N - 1) throw length_error("'" + string(text) + "' does not fit in an item record");
+        memcpy(target, text.data(), text.size());
+        memset(target + text.size(), 0, N - text.size());
+    }
+
+    static uint8_t registeredCategory(const string& category) {
+        int categoryId = categories.findOrAdd(category);
+        if (categoryId == -1) throw invalid_argument("Category '" + category + "' cannot be registered");
+        return categoryId;
+    }
+
+public:
+    // Constructor
+    Item(string_view itemId = "", string_view itemName = "", int itemQuantity = 0, double itemPrice = 0.0,
+         const string& itemCategory = "")
+            : priceCents(toCents(itemPrice)), quantity(itemQuantity),
+              categoryId(itemCategory.empty() ? 0 : registeredCategory(itemCategory)) {
+        copyText(id, itemId);
+        copyText(name, itemName);
+    }
+
+    // Checks item fields that come from outside (files, replication) before an Item is built
+    // from them; error says what is wrong. Registers the category if it is new.
+    static bool checkFields(string_view itemId, string_view itemName, const string& itemCategory, double itemPrice,
+                            string& error) {
+        if (itemId.empty() || itemId.size() > MAX_ID_LENGTH) {
+            error = "Item ID '" + string(itemId) + "' is empty or longer than " + to_string(MAX_ID_LENGTH) + " characters";
+        } else if (itemName.size() > MAX_NAME_LENGTH) {
+            error = "Name of item " + string(itemId) + " is longer than " + to_string(MAX_NAME_LENGTH) + " characters";
+        } else if (!validPrice(itemPrice)) {
+            error = "Price of item " + string(itemId) + " is not a valid price";
+        } else if (categories.findOrAdd(itemCategory) == -1) {
+            error = "Category '" + itemCategory + "' of item " + string(itemId) + " cannot be registered";
+        } else {
+            return true;
+        }
+        return false;
+    }
+
+    // Whether a record copied in as raw bytes (an item file) is one this program could have
+    // written: terminated, non-empty ID, a valid price and a category in the given range
+    bool wellFormed(int categoryCount) const {
+        return id[0] != '\0' && memchr(id, 0, sizeof(id)) != nullptr && memchr(name, 0, sizeof(name)) != nullptr &&
+               categoryId < max(categoryCount, 1) && validPrice(priceCents / 100.0);
+    }
+
+    // Getters and setters for encapsulation
+    string_view getId() const { return id; }
+    void setId(string_view newId) { copyText(id, newId); }
+
+    string_view getName() const { return name; }
+    void setName(string_view newName) { copyText(name, newName); }
+
+    int getQuantity() const { return quantity; }
+    void setQuantity(int newQuantity) { quantity = newQuantity; }
+
+    // Reads the quantity while other threads may be adjusting it (atomic_ref needs a
+    // non-const object, but a load never writes through it)
+    int loadQuantity() const {
+        return atomic_ref<int32_t>(const_cast<int32_t&>(quantity)).load(memory_order_acquire);
+    }
+
+    // Atomically adds delta to the quantity (compare-and-swap loop, safe against concurrent
+    // adjustments of the same item). Fails without changing anything if the result would not
+    // fit in 32 bits, or if failIfNegative is set and it would drop below zero. oldQuantity
+    // receives the value that was replaced (or the current one on failure).
+    bool adjustQuantity(int delta, bool failIfNegative, int& oldQuantity) {
+        atomic_ref<int32_t> current(quantity);
+        int32_t expected = current.load(memory_order_relaxed);
+        int32_t updated;
+
+        do {
+            oldQuantity = expected;
+            if (__builtin_add_overflow(expected, delta, &updated)) return false;
+            if (failIfNegative && updated < 0) return false;
+        } while (!current.compare_exchange_weak(expected, updated,
+                                                memory_order_acq_rel, memory_order_relaxed));
+        oldQuantity = expected;
+        return true;
+    }
+
+    double getPrice() const { return priceCents / 100.0; }
+    void setPrice(double newPrice) { priceCents = toCents(newPrice); }
+
+    long long getPriceCents() const { return priceCents; }
+
+    const string& getCategory() const { return categories.name(categoryId); }
+    int getCategoryId() const { return categoryId; }
+    void setCategoryId(int newCategoryId) { categoryId = newCategoryId; }
+    void setCategory(const string& newCategory) { categoryId = registeredCategory(newCategory); }
+
+    // Method to display item details (abstraction for the user)
+    void displayItem() const {
+        cout << "ID: " << getId() << ", Name: " << getName()
+             << ", Quantity: " << quantity << ", Price: " << getPrice()
+             << ", Category: " << getCategory() << endl;
+    }
+};
+
+static_assert(sizeof(Item) == 64, "Item is meant to fill exactly one cache line");
+static_assert(is_trivially_copyable<Item>::value, "Item must stay copyable with memcpy");
+
+// Running totals for a group of items (one category, or the whole inventory)
+struct StockTotals {
+    long long itemCount = 0;    // Number of distinct items
+    long long totalUnits = 0;   // Sum of quantities
+    __int128 totalValue = 0;    // Sum of quantity x price, in cents; one item alone can exceed a long long
+
+    // Adds (sign = 1) or removes (sign = -1) one item's contribution
+    void apply(const Item& item, int sign) {
+        itemCount += sign;
+        totalUnits += sign * (long long) item.getQuantity();
+        totalValue += sign * (__int128) item.getQuantity() * item.getPriceCents();
+    }
+
+    // Accounts for delta units added to (or taken from) one item
+    void applyQuantityDelta(const Item& item, int delta) {
+        totalUnits += delta;
+        totalValue += (__int128) delta * item.getPriceCents();
+    }
+};
+
+
+// One line of a batch update; fields without a new value are left unchanged
+struct ItemChange {
+    string id;
+    bool hasQuantity = false;
+    int quantity = 0;
+    bool hasPrice = false;
+    double price = 0.0;
+};
+
+// A change to one item, as delivered to change-feed subscribers
+struct ChangeEvent {
+    enum Type { Added, Updated, Removed };
+
+    Type type;
     string id;
     string name;
-    int quantity;
-    double price;
     string category;
+    int oldQuantity;    // 0 for Added
+    int newQuantity;    // 0 for Removed
+    double oldPrice;
+    double newPrice;
+};
+
+// Bounded lock-free multi-producer/multi-consumer queue (Vyukov's design). Every slot carries a
+// sequence number that tells producers and consumers whose turn it is, so push and pop only
+// need one CAS on the shared position counter and never block.
+template<typename T>
+class RingBuffer {
+private:
+    struct Slot {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    unique_ptr<Slot[]> slots;
+    size_t mask;
+    atomic<size_t> enqueuePos{0};
+    atomic<size_t> dequeuePos{0};
+
+public:
+    // capacity is rounded up to a power of two
+    explicit RingBuffer(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+
+        slots.reset(new Slot[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; i++) slots[i].sequence.store(i, memory_order_relaxed);
+    }
+
+    // Returns false if the buffer is full
+    bool push(const T& value) {
+        size_t pos = enqueuePos.load(memory_order_relaxed);
+        while (true) {
+            Slot &slot = slots[pos & mask];
+            size_t sequence = slot.sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    slot.value = value;
+                    slot.sequence.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false if the buffer is empty
+    bool pop(T& value) {
+        size_t pos = dequeuePos.load(memory_order_relaxed);
+        while (true) {
+            Slot &slot = slots[pos & mask];
+            size_t sequence = slot.sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t) sequence - (intptr_t) (pos + 1);
+
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    value = slot.value;
+                    slot.sequence.store(pos + mask + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeuePos.load(memory_order_relaxed);
+            }
+        }
+    }
+};
+
+// Push-based change notifications. Subscribers register a filter and get their own ring
+// buffer; every mutation is pushed to the buffers whose filter matches, so a consumer only
+// sees the events it asked for and never has to scan the inventory.
+class ChangeFeed {
+public:
+    enum FilterType { AllItems, OneItem, OneCategory, BelowThreshold };
+
+    struct Subscription {
+        FilterType filter;
+        string key;          // Item ID for OneItem, category for OneCategory
+        int threshold;       // For BelowThreshold: fire when quantity drops to this value or lower
+        RingBuffer<ChangeEvent> events;
+        atomic<long long> dropped{0};  // Events lost because the consumer fell behind
+
+        Subscription(FilterType filterType, const string& filterKey, int filterThreshold, size_t capacity)
+                : filter(filterType), key(filterKey), threshold(filterThreshold), events(capacity) {}
+
+        bool matches(const ChangeEvent& event) const {
+            switch (filter) {
+                case OneItem:
+                    return event.id == key;
+                case OneCategory:
+                    return event.category == key;
+                case BelowThreshold:
+                    // Only the change that crosses the threshold, not every change below it
+                    return event.type != ChangeEvent::Removed && event.newQuantity <= threshold &&
+                           (event.type == ChangeEvent::Added || event.oldQuantity > threshold);
+                default:
+                    return true;
+            }
+        }
+    };
+
+private:
+    vector<unique_ptr<Subscription>> subscriptions;
+
+public:
+    // Registers a subscriber; call before mutations start arriving from other threads
+    Subscription* subscribe(FilterType filter, const string& key = "", int threshold = 0, size_t capacity = 1024) {
+        subscriptions.emplace_back(new Subscription(filter, key, threshold, capacity));
+        return subscriptions.back().get();
+    }
+
+    // Delivers an event to every matching subscriber (safe to call from several threads)
+    void publish(const ChangeEvent& event) {
+        for (auto &subscription : subscriptions) {
+            if (subscription->matches(event) && !subscription->events.push(event)) {
+                subscription->dropped++;
+            }
+        }
+    }
+};
+
+// Computes the Levenshtein (edit) distance between two strings using two rows of the DP table
+int editDistance(const string& a, const string& b) {
+    vector<int> prev(b.size() + 1), curr(b.size() + 1);
+    for (size_t j = 0; j <= b.size(); j++) prev[j] = j;
+
+    for (size_t i = 1; i <= a.size(); i++) {
+        curr[0] = i;
+        for (size_t j = 1; j <= b.size(); j++) {
+            int cost = (a[i - 1] == b[j - 1]) ? 0 : 1;
+            curr[j] = min({prev[j] + 1, curr[j - 1] + 1, prev[j - 1] + cost});
+        }
+        swap(prev, curr);
+    }
+    return prev[b.size()];
+}
+
+// BK-tree over item names, used for typo-tolerant lookups.
+// Each node holds one (lowercased) name and the IDs of the items carrying it; children are
+// keyed by their edit distance to the node, so a search within distance r only has to visit
+// children whose key lies in [d - r, d + r].
+class NameIndex {
+private:
+    struct Node {
+        string name;
+        vector<string> ids;                 // Items with this name (empty once all are removed)
+        vector<pair<int, int>> children;    // (distance to this node, child node index)
+    };
+
+    vector<Node> nodes;
+
+    static string normalize(string_view text) {
+        string name(text);
+        for (auto &c : name) c = tolower(c);
+        return name;
+    }
+
+public:
+    // A single fuzzy match: distance to the query, the stored name and one matching item ID
+    struct Match {
+        int distance;
+        string name;
+        string id;
+    };
+
+    // Adds an item's name to the tree
+    void insert(string_view itemName, string_view itemId) {
+        string name = normalize(itemName);
+        string id(itemId);
+
+        if (nodes.empty()) {
+            nodes.push_back({name, {id}, {}});
+            return;
+        }
+
+        int current = 0;
+        while (true) {
+            int distance = editDistance(name, nodes[current].name);
+            if (distance == 0) {
+                nodes[current].ids.push_back(id);  // Same name already in the tree
+                return;
+            }
+
+            int next = -1;
+            for (auto &child : nodes[current].children) {
+                if (child.first == distance) {
+                    next = child.second;
+                    break;
+                }
+            }
+
+            if (next == -1) {
+                nodes.push_back({name, {id}, {}});
+                nodes[current].children.push_back({distance, (int) nodes.size() - 1});
+                return;
+            }
+            current = next;
+        }
+    }
+
+    // Removes an item's name from the tree (the node stays as a routing point)
+    void erase(string_view itemName, string_view itemId) {
+        string name = normalize(itemName);
+        string id(itemId);
+        int current = nodes.empty() ? -1 : 0;
+
+        while (current != -1) {
+            int distance = editDistance(name, nodes[current].name);
+            if (distance == 0) {
+                auto &ids = nodes[current].ids;
+                ids.erase(remove(ids.begin(), ids.end(), id), ids.end());
+                return;
+            }
+
+            int next = -1;
+            for (auto &child : nodes[current].children) {
+                if (child.first == distance) {
+                    next = child.second;
+                    break;
+                }
+            }
+            current = next;
+        }
+    }
+
+    // Returns up to k closest names within maxDistance of the query, nearest first
+    vector<Match> search(const string& query, int maxDistance, size_t k) const {
+        vector<Match> matches;
+        if (nodes.empty() || k == 0) return matches;
+
+        string target = normalize(query);
+        vector<int> pending = {0};
+
+        while (!pending.empty()) {
+            const Node &node = nodes[pending.back()];
+            pending.pop_back();
+
+            int distance = editDistance(target, node.name);
+            if (distance <= maxDistance) {
+                for (auto &id : node.ids) {
+                    matches.push_back({distance, node.name, id});
+                }
+            }
+
+            // Triangle inequality: only subtrees at distance [d - r, d + r] can hold matches
+            for (auto &child : node.children) {
+                if (child.first >= distance - maxDistance && child.first <= distance + maxDistance) {
+                    pending.push_back(child.second);
+                }
+            }
+        }
+
+        auto closer = [](const Match& a, const Match& b) {
+            return a.distance != b.distance ? a.distance < b.distance : a.name < b.name;
+        };
+        if (matches.size() > k) {
+            partial_sort(matches.begin(), matches.begin() + k, matches.end(), closer);
+            matches.resize(k);
+        } else {
+            sort(matches.begin(), matches.end(), closer);
+        }
+        return matches;
+    }
+};
+
+// Sort keys as compile-time policies: each names the item field it orders by
+struct ByName {
+    using Key = string;
+    static string_view key(const Item& item) { return item.getName(); }
+};
+
+struct ByPrice {
+    using Key = double;
+    static double key(const Item& item) { return item.getPrice(); }
+};
+
+struct ByQuantity {
+    using Key = int;
+    static int key(const Item& item) { return item.getQuantity(); }
+};
+
+// Sort directions as compile-time policies
+struct Ascending {
+    template<typename T>
+    static bool before(const T& a, const T& b) { return a < b; }
+};
+
+struct Descending {
+    template<typename T>
+    static bool before(const T& a, const T& b) { return b < a; }
+};
+
+// Comparator for one (key, direction) pair; both are resolved at compile time, so a sort
+// instantiated with it compares fields directly with no per-comparison branching
+template<typename KeyPolicy, typename OrderPolicy>
+struct ItemOrder {
+    bool operator()(const Item& a, const Item& b) const {
+        return OrderPolicy::before(KeyPolicy::key(a), KeyPolicy::key(b));
+    }
+};
+
+// Calls action with the ItemOrder matching the user's choice of key ("name", "price",
+// "quantity") and direction. The choice is made once here; action is typically a generic
+// lambda, so each of the six combinations gets its own specialized instantiation.
+template<typename Action>
+void withItemOrder(const string& key, bool ascending, Action action) {
+    if (key == "name") {
+        if (ascending) action(ItemOrder<ByName, Ascending>());
+        else action(ItemOrder<ByName, Descending>());
+    } else if (key == "price") {
+        if (ascending) action(ItemOrder<ByPrice, Ascending>());
+        else action(ItemOrder<ByPrice, Descending>());
+    } else {
+        if (ascending) action(ItemOrder<ByQuantity, Ascending>());
+        else action(ItemOrder<ByQuantity, Descending>());
+    }
+}
+
+// Ordered index from one item field (name, price, quantity) to item IDs.
+// Entries are also partitioned by category, so a range restricted to one category is answered
+// from that category's tree directly: O(log n + k) either way, results in key order.
+template<typename KeyPolicy>
+class OrderedIndex {
+public:
+    using Key = typename KeyPolicy::Key;
+    using Entry = pair<Key, string>;  // (key, item ID) - the ID keeps equal keys distinct
+
+private:
+    set<Entry> allEntries;
+    unordered_map<string, set<Entry>> categoryEntries;
+
+    // Picks the tree to read from: the whole index, or one category's partition (nullptr if unknown)
+    const set<Entry>* entriesFor(const string& category) const {
+        if (category.empty()) return &allEntries;
+
+        auto it = categoryEntries.find(category);
+        return (it == categoryEntries.end()) ? nullptr : &it->second;
+    }
+
+public:
+    // Adds an item under its current key
+    void insert(const Item& item) {
+        insert(item, Key(KeyPolicy::key(item)));
+    }
+
+    // Adds an item under the given key
+    void insert(const Item& item, const Key& key) {
+        Entry entry(key, item.getId());
+        allEntries.insert(entry);
+        categoryEntries[item.getCategory()].insert(entry);
+    }
+
+    // Removes an item; must be called before the indexed field changes
+    void erase(const Item& item) {
+        erase(item, Key(KeyPolicy::key(item)));
+    }
+
+    // Removes an item that was indexed under the given (previous) key
+    void erase(const Item& item, const Key& key) {
+        Entry entry(key, item.getId());
+        allEntries.erase(entry);
+        categoryEntries[item.getCategory()].erase(entry);
+    }
+
+    // Finds the smallest and largest key (in one category if given); returns false if there are none
+    bool bounds(Key& lowest, Key& highest, const string& category = "") const {
+        const set<Entry>* entries = entriesFor(category);
+        if (entries == nullptr || entries->empty()) return false;
+
+        lowest = entries->begin()->first;
+        highest = entries->rbegin()->first;
+        return true;
+    }
+
+    // Returns every key in ascending order
+    vector<Key> keys() const {
+        vector<Key> result;
+        result.reserve(allEntries.size());
+        for (auto &entry : allEntries) result.push_back(entry.first);
+        return result;
+    }
+
+    // Returns the IDs of items with low <= key <= high (in one category if given), in key order
+    vector<string> range(const Key& low, const Key& high, const string& category = "") const {
+        vector<string> ids;
+        const set<Entry>* entries = entriesFor(category);
+        if (entries == nullptr) return ids;
+
+        for (auto it = entries->lower_bound({low, ""}); it != entries->end() && it->first <= high; ++it) {
+            ids.push_back(it->second);
+        }
+        return ids;
+    }
+
+    // Returns up to count entries starting at the first key >= key (used to jump to a key)
+    vector<Entry> pageFrom(const Key& key, size_t count, const string& category = "") const {
+        vector<Entry> page;
+        const set<Entry>* entries = entriesFor(category);
+        if (entries == nullptr) return page;
+
+        for (auto it = entries->lower_bound({key, ""}); it != entries->end() && page.size() < count; ++it) {
+            page.push_back(*it);
+        }
+        return page;
+    }
+
+    // Returns up to count entries that follow the cursor entry, in key order
+    vector<Entry> pageAfter(const Entry& cursor, size_t count, const string& category = "") const {
+        vector<Entry> page;
+        const set<Entry>* entries = entriesFor(category);
+        if (entries == nullptr) return page;
+
+        for (auto it = entries->upper_bound(cursor); it != entries->end() && page.size() < count; ++it) {
+            page.push_back(*it);
+        }
+        return page;
+    }
+
+    // Returns up to count entries that precede the cursor entry, in key order
+    vector<Entry> pageBefore(const Entry& cursor, size_t count, const string& category = "") const {
+        vector<Entry> page;
+        const set<Entry>* entries = entriesFor(category);
+        if (entries == nullptr) return page;
+
+        for (auto it = entries->lower_bound(cursor); it != entries->begin() && page.size() < count;) {
+            page.push_back(*--it);
+        }
+        reverse(page.begin(), page.end());
+        return page;
+    }
+
+    // Returns the first count entries (in one category if given)
+    vector<Entry> firstPage(size_t count, const string& category = "") const {
+        vector<Entry> page;
+        const set<Entry>* entries = entriesFor(category);
+        if (entries == nullptr) return page;
+
+        for (auto it = entries->begin(); it != entries->end() && page.size() < count; ++it) {
+            page.push_back(*it);
+        }
+        return page;
+    }
+};
+
+// Ad-hoc item filters such as "category = electronics and quantity < 10 and price > 50".
+//   filter    := clause ('or' clause)*
+//   clause    := condition ('and' condition)*
+//   condition := field op value    field: id, name, category, quantity, price
+//                                  op: = != < <= > >=
+// Text values may be quoted ("Blue Shirt"). IDs compare exactly, like every other ID lookup;
+// names compare case-insensitively. 'and' binds tighter than 'or', so a parsed filter is an
+// OR of AND-clauses.
+// Parsing does all per-query work once: category names become registry IDs and prices become
+// cents, so a scan only compares integers. Each clause runs as a pipeline over a selection
+// vector of positions: the first condition scans the items, later ones only narrow what
+// survived, each with a loop specialised for its field and operator (no per-item dispatch).
+// Conditions run cheapest and most selective first: category, then numbers, then text.
+class ItemFilter {
+public:
+    enum Field { Id, Name, Category, Quantity, Price };
+    enum Op { Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual };
+
+    struct Condition {
+        Field field;
+        Op op;
+        long long number;  // Quantity, price in cents, or category ID
+        string text;       // ID or name
+    };
+
+    vector<vector<Condition>> clauses;
+
+private:
+    static int compareText(string_view a, string_view b) {
+        for (size_t i = 0; i < a.size() && i < b.size(); i++) {
+            int ca = tolower((unsigned char) a[i]), cb = tolower((unsigned char) b[i]);
+            if (ca != cb) return ca - cb;
+        }
+        return (int) a.size() - (int) b.size();
+    }
+
+    template<Op O, typename T>
+    static bool compare(T a, T b) {
+        if constexpr (O == Equal) return a == b;
+        else if constexpr (O == NotEqual) return a != b;
+        else if constexpr (O == Less) return a < b;
+        else if constexpr (O == LessEqual) return a <= b;
+        else if constexpr (O == Greater) return a > b;
+        else return a >= b;
+    }
+
+    template<Field F, Op O>
+    static bool matches(const Item& item, const Condition& condition) {
+        if constexpr (F == Quantity) return compare<O>((long long) item.getQuantity(), condition.number);
+        else if constexpr (F == Price) return compare<O>(item.getPriceCents(), condition.number);
+        else if constexpr (F == Category) return compare<O>((long long) item.getCategoryId(), condition.number);
+        else if constexpr (F == Id) return compare<O>(item.getId().compare(condition.text), 0);
+        else return compare<O>(compareText(item.getName(), condition.text), 0);
+    }
+
+    // Keeps the positions whose item satisfies the condition, in place
+    template<Field F, Op O>
+    static void narrow(const Item* items, vector<int>& positions, const Condition& condition) {
+        size_t kept = 0;
+        for (int position : positions) {
+            if (matches<F, O>(items[position], condition)) positions[kept++] = position;
+        }
+        positions.resize(kept);
+    }
+
+    template<Field F>
+    static void narrowByOp(const Item* items, vector<int>& positions, const Condition& condition) {
+        switch (condition.op) {
+            case Equal: narrow<F, Equal>(items, positions, condition); break;
+            case NotEqual: narrow<F, NotEqual>(items, positions, condition); break;
+            case Less: narrow<F, Less>(items, positions, condition); break;
+            case LessEqual: narrow<F, LessEqual>(items, positions, condition); break;
+            case Greater: narrow<F, Greater>(items, positions, condition); break;
+            case GreaterEqual: narrow<F, GreaterEqual>(items, positions, condition); break;
+        }
+    }
+
+public:
+    // Keeps the positions whose item satisfies the condition, in place
+    static void narrow(const Item* items, vector<int>& positions, const Condition& condition) {
+        switch (condition.field) {
+            case Id: narrowByOp<Id>(items, positions, condition); break;
+            case Name: narrowByOp<Name>(items, positions, condition); break;
+            case Category: narrowByOp<Category>(items, positions, condition); break;
+            case Quantity: narrowByOp<Quantity>(items, positions, condition); break;
+            case Price: narrowByOp<Price>(items, positions, condition); break;
+        }
+    }
+
+private:
+    // Splits the text into words, quoted strings and operator symbols
+    static vector<string> tokenize(const string& text) {
+        vector<string> tokens;
+        size_t i = 0;
+        while (i < text.size()) {
+            if (isspace((unsigned char) text[i])) {
+                i++;
+            } else if (text[i] == '"') {
+                size_t close = text.find('"', i + 1);
+                if (close == string::npos) close = text.size();
+                tokens.push_back(text.substr(i, close - i));  // Keeps the opening quote as a marker
+                i = close + 1;
+            } else {
+                bool symbol = strchr("=!<>", text[i]) != nullptr;
+                size_t start = i;
+                while (i < text.size() && !isspace((unsigned char) text[i]) && text[i] != '"' &&
+                       (strchr("=!<>", text[i]) != nullptr) == symbol) {
+                    i++;
+                }
+                tokens.push_back(text.substr(start, i - start));
+            }
+        }
+        return tokens;
+    }
+
+    static string lowercase(string text) {
+        for (auto &c : text) c = tolower(c);
+        return text;
+    }
+
+    // Lower numbers run first
+    static int cost(const Condition& condition) {
+        if (condition.field == Category) return 0;
+        return (condition.field == Quantity || condition.field == Price) ? 1 : 2;
+    }
+
+public:
+    // Parses a filter; on failure returns false and describes the problem in error
+    static bool parse(const string& text, ItemFilter& filter, string& error) {
+        static const pair<const char*, Field> fieldNames[] = {
+                {"id", Id}, {"name", Name}, {"category", Category}, {"quantity", Quantity}, {"price", Price}};
+        static const pair<const char*, Op> opNames[] = {
+                {"=", Equal}, {"==", Equal}, {"!=", NotEqual}, {"<", Less}, {"<=", LessEqual},
+                {">", Greater}, {">=", GreaterEqual}};
+
+        vector<string> tokens = tokenize(text);
+        filter.clauses.assign(1, {});
+
+        for (size_t t = 0; t < tokens.size(); t += 3) {
+            if (t + 2 >= tokens.size()) {
+                error = "Expected 'field op value' at the end";
+                return false;
+            }
+
+            Condition condition;
+            string fieldName = lowercase(tokens[t]);
+            auto field = find_if(begin(fieldNames), end(fieldNames), [&](auto &f) { return fieldName == f.first; });
+            if (field == end(fieldNames)) {
+                error = "Unknown field '" + tokens[t] + "' (use id, name, category, quantity or price)";
+                return false;
+            }
+            condition.field = field->second;
+
+            auto op = find_if(begin(opNames), end(opNames), [&](auto &o) { return tokens[t + 1] == o.first; });
+            if (op == end(opNames)) {
+                error = "Unknown operator '" + tokens[t + 1] + "'";
+                return false;
+            }
+            condition.op = op->second;
+
+            string value = tokens[t + 2];
+            if (!value.empty() && value[0] == '"') value.erase(0, 1);
+
+            if (condition.field == Category) {
+                condition.number = categories.find(value);
+                if (condition.number == -1) {
+                    error = "Unknown category '" + value + "'";
+                    return false;
+                }
+                if (condition.op != Equal && condition.op != NotEqual) {
+                    error = "Categories can only be compared with = or !=";
+                    return false;
+                }
+            } else if (condition.field == Quantity) {
+                int quantity;
+                auto result = from_chars(value.data(), value.data() + value.size(), quantity);
+                if (result.ec != errc() || result.ptr != value.data() + value.size()) {
+                    error = "Quantity '" + value + "' is not a whole number";
+                    return false;
+                }
+                condition.number = quantity;
+            } else if (condition.field == Price) {
+                double price;
+                if (!parsePrice(value, price)) {
+                    error = "Price '" + value + "' is not a valid price";
+                    return false;
+                }
+                condition.number = toCents(price);
+            } else {
+                condition.text = value;
+            }
+            filter.clauses.back().push_back(condition);
+
+            // Connective to the next condition
+            if (t + 3 < tokens.size()) {
+                string connective = lowercase(tokens[t + 3]);
+                if (connective == "or") {
+                    filter.clauses.push_back({});
+                } else if (connective != "and") {
+                    error = "Expected 'and' or 'or' before '" + tokens[t + 3] + "'";
+                    return false;
+                }
+                if (t + 4 >= tokens.size()) {
+                    error = "Expected a condition after '" + tokens[t + 3] + "'";
+                    return false;
+                }
+                t++;
+            }
+        }
+
+        if (filter.clauses.back().empty()) {
+            error = "The filter is empty";
+            return false;
+        }
+        for (auto &clause : filter.clauses) {
+            stable_sort(clause.begin(), clause.end(), [](const Condition& a, const Condition& b) {
+                return cost(a) < cost(b);
+            });
+        }
+        return true;
+    }
+
+    // Writes a condition back as text, e.g. "price > 50"
+    static string describe(const Condition& condition) {
+        static const char* fieldNames[] = {"id", "name", "category", "quantity", "price"};
+        static const char* opNames[] = {"=", "!=", "<", "<=", ">", ">="};
+
+        string value;
+        if (condition.field == Category) {
+            value = categories.name(condition.number);
+        } else if (condition.field == Quantity) {
+            value = to_string(condition.number);
+        } else if (condition.field == Price) {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%.2f", condition.number / 100.0);
+            value = buffer;
+        } else {
+            value = condition.text;
+        }
+        return string(fieldNames[condition.field]) + " " + opNames[condition.op] + " " + value;
+    }
+
+    // A filter with a single condition, for reports built in code
+    static ItemFilter where(Field field, Op op, long long number) {
+        ItemFilter filter;
+        filter.clauses.push_back({{field, op, number, ""}});
+        return filter;
+    }
+
+    // Returns the positions of the matching items, in storage order
+    vector<int> select(const Item* items, int count) const {
+        vector<int> result;
+        for (auto &clause : clauses) {
+            vector<int> positions(count);
+            for (int i = 0; i < count; i++) positions[i] = i;
+            for (auto &condition : clause) {
+                if (positions.empty()) break;
+                narrow(items, positions, condition);
+            }
+
+            vector<int> merged;
+            set_union(result.begin(), result.end(), positions.begin(), positions.end(), back_inserter(merged));
+            result.swap(merged);
+        }
+        return result;
+    }
+};
+
+// Equi-depth histogram of an integer column (quantities, prices in cents) used by the query
+// planner: each bucket covers about the same number of items, so skewed columns still get
+// useful estimates. Values inside a bucket are assumed to be spread evenly.
+class ValueHistogram {
+private:
+    static constexpr int MAX_BUCKETS = 16;
+
+    struct Bucket {
+        long long low, high;
+        int count;
+    };
+
+    vector<Bucket> buckets;
+    int total = 0;
+
+public:
+    // Builds the buckets from values in ascending order
+    void build(const vector<long long>& sortedValues) {
+        buckets.clear();
+        total = sortedValues.size();
+
+        int bucketCount = min<int>(MAX_BUCKETS, total);
+        for (int b = 0; b < bucketCount; b++) {
+            size_t first = (size_t) b * total / bucketCount;
+            size_t last = (size_t) (b + 1) * total / bucketCount;
+            buckets.push_back({sortedValues[first], sortedValues[last - 1], (int) (last - first)});
+        }
+    }
+
+    // Estimated fraction of values <= value
+    double fractionAtMost(long long value) const {
+        if (total == 0) return 0;
+
+        double rows = 0;
+        for (auto &bucket : buckets) {
+            if (value >= bucket.high) {
+                rows += bucket.count;
+            } else if (value >= bucket.low) {
+                rows += bucket.count * (double) (value - bucket.low + 1) / (bucket.high - bucket.low + 1);
+            }
+        }
+        return rows / total;
+    }
+
+    // Estimated fraction of values satisfying "column op value"
+    double selectivity(ItemFilter::Op op, long long value) const {
+        switch (op) {
+            case ItemFilter::Equal: return fractionAtMost(value) - fractionAtMost(value - 1);
+            case ItemFilter::NotEqual: return 1 - (fractionAtMost(value) - fractionAtMost(value - 1));
+            case ItemFilter::Less: return fractionAtMost(value - 1);
+            case ItemFilter::LessEqual: return fractionAtMost(value);
+            case ItemFilter::Greater: return 1 - fractionAtMost(value);
+            default: return 1 - fractionAtMost(value - 1);
+        }
+    }
+};
+
+// Binary encoding shared by snapshot and checkpoint files: fixed-width numbers and
+// length-prefixed strings, appended to one buffer so a whole file is written in one call
+class RecordWriter {
+public:
+    string buffer;
+
+    void putByte(uint8_t value) { buffer.push_back((char) value); }
+    void putUint32(uint32_t value) { buffer.append((const char*) &value, sizeof(value)); }
+    void putUint64(uint64_t value) { buffer.append((const char*) &value, sizeof(value)); }
+    void putInt32(int32_t value) { buffer.append((const char*) &value, sizeof(value)); }
+    void putDouble(double value) { buffer.append((const char*) &value, sizeof(value)); }
+
+    void putString(string_view value) {
+        putUint32(value.size());
+        buffer.append(value);
+    }
+
+    void putItem(const Item& item) {
+        putString(item.getId());
+        putString(item.getName());
+        putString(item.getCategory());
+        putInt32(item.getQuantity());
+        putDouble(item.getPrice());
+    }
+};
+
+// Reads what RecordWriter wrote. Any read past the end clears ok, so a truncated file is
+// detected instead of producing garbage.
+class RecordReader {
+private:
+    const char *pos;
+    const char *end;
+
+    bool take(void* out, size_t size) {
+        if (!ok || (size_t) (end - pos) < size) {
+            ok = false;
+            return false;
+        }
+        memcpy(out, pos, size);
+        pos += size;
+        return true;
+    }
+
+public:
+    bool ok = true;
+    string error;  // Why reading stopped at a complete but invalid record ("" if truncated)
+
+    RecordReader(const char* data, size_t size) : pos(data), end(data + size) {}
+
+    // Stops reading because a record holds values no item can have
+    void fail(const string& reason) {
+        if (ok) error = reason;
+        ok = false;
+    }
+
+    bool atEnd() const { return pos == end; }
+
+    uint8_t getByte() { uint8_t value = 0; take(&value, sizeof(value)); return value; }
+    uint32_t getUint32() { uint32_t value = 0; take(&value, sizeof(value)); return value; }
+    uint64_t getUint64() { uint64_t value = 0; take(&value, sizeof(value)); return value; }
+    int32_t getInt32() { int32_t value = 0; take(&value, sizeof(value)); return value; }
+    double getDouble() { double value = 0; take(&value, sizeof(value)); return value; }
+
+    string getString() {
+        uint32_t size = getUint32();
+        if (!ok || (size_t) (end - pos) < size) {
+            ok = false;
+            return "";
+        }
+        string value(pos, size);
+        pos += size;
+        return value;
+    }
+
+    // Reads an item; fields that do not fit an item stop the reader instead of being cut
+    Item getItem() {
+        string id = getString();
+        string name = getString();
+        string category = getString();
+        int quantity = getInt32();
+        double price = getDouble();
+
+        string reason;
+        if (!ok) return Item();
+        if (!Item::checkFields(id, name, category, price, reason)) {
+            fail(reason);
+            return Item();
+        }
+        return Item(id, name, quantity, price, category);
+    }
+
+    // Reads an item ID on its own (e.g. a removal)
+    string getId() {
+        string id = getString();
+        if (ok && (id.empty() || id.size() > Item::MAX_ID_LENGTH)) fail("Item ID '" + id + "' does not fit an item");
+        return ok ? id : "";
+    }
+};
+
+// Read-only memory mapping of a whole file. Loading decodes straight from the page cache
+// instead of copying the file into a buffer first.
+class MappedFile {
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() { close(); }
+
+    // Maps the file; returns false if it cannot be opened (an empty file maps to no bytes)
+    bool open(const string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1) return false;
+
+        struct stat info;
+        bool ok = fstat(fd, &info) == 0;
+        if (ok && info.st_size > 0) {
+            void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = mapping != MAP_FAILED;
+            if (ok) {
+                data = (const char*) mapping;
+                size = info.st_size;
+            }
+        }
+        ::close(fd);
+        return ok;
+    }
+
+    void close() {
+        if (data != nullptr) munmap((void*) data, size);
+        data = nullptr;
+        size = 0;
+    }
+
+    string_view contents() const { return string_view(data, size); }
+};
+
+// Streams items to a file descriptor as CSV (with a header row) or JSON Lines. Fields are
+// escaped and numbers formatted (to_chars, prices from integer cents) straight into one
+// large output buffer, which goes out in a single write() whenever it fills, so exporting
+// costs a pass over the items plus a few big sequential writes. Without a file descriptor
+// (-1) everything stays in the buffer, for exports formatted in parallel and written later.
+class ItemExporter {
+public:
+    enum Format { Csv, JsonLines };
+
+private:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+    static constexpr size_t MAX_RECORD_SIZE = 512;  // Worst case for one escaped 64-byte item
+
+    int fd;
+    Format format;
+    bool withWarehouse;  // Leading warehouse field, for exports spanning several warehouses
+    string buffer;
+    bool ok = true;
+    long long exported = 0;
+
+    void flush() {
+        if (fd == -1) return;
+
+        for (size_t written = 0; ok && written < buffer.size();) {
+            ssize_t n = ::write(fd, buffer.data() + written, buffer.size() - written);
+            if (n == -1 && errno == EINTR) continue;
+            if (n <= 0) ok = false;
+            else written += n;
+        }
+        buffer.clear();
+    }
+
+    void putNumber(long long value) {
+        char digits[24];
+        auto result = to_chars(digits, digits + sizeof(digits), value);
+        buffer.append(digits, result.ptr - digits);
+    }
+
+    // Prints cents as a decimal price with two places, e.g. 1999 -> 19.99
+    void putPrice(long long cents) {
+        if (cents < 0) {
+            buffer.push_back('-');
+            cents = -cents;
+        }
+        putNumber(cents / 100);
+        buffer.push_back('.');
+        buffer.push_back('0' + cents % 100 / 10);
+        buffer.push_back('0' + cents % 10);
+    }
+
+    // CSV quotes a field only if it contains a separator, quote or line break
+    void putCsvField(string_view text) {
+        if (text.find_first_of(",\"\r\n") == string_view::npos) {
+            buffer.append(text);
+            return;
+        }
+        buffer.push_back('"');
+        for (char c : text) {
+            if (c == '"') buffer.push_back('"');
+            buffer.push_back(c);
+        }
+        buffer.push_back('"');
+    }
+
+    void putJsonString(string_view text) {
+        buffer.push_back('"');
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                buffer.push_back('\\');
+                buffer.push_back(c);
+            } else if ((unsigned char) c < 0x20) {
+                static const char hex[] = "0123456789abcdef";
+                buffer.append("\\u00");
+                buffer.push_back(hex[(unsigned char) c >> 4]);
+                buffer.push_back(hex[c & 0xf]);
+            } else {
+                buffer.push_back(c);
+            }
+        }
+        buffer.push_back('"');
+    }
+
+public:
+    ItemExporter(int outputFd, Format outputFormat, bool includeWarehouse = false, bool header = true)
+            : fd(outputFd), format(outputFormat), withWarehouse(includeWarehouse) {
+        buffer.reserve(BUFFER_SIZE);
+        if (format == Csv && header) {
+            buffer.append(withWarehouse ? "warehouse,id,name,category,quantity,price\n"
+                                        : "id,name,category,quantity,price\n");
+        }
+    }
+
+    ItemExporter(const ItemExporter&) = delete;
+    ItemExporter& operator=(const ItemExporter&) = delete;
+
+    // Appends one item to the output
+    void write(const Item& item, string_view warehouse = "") {
+        if (format == Csv) {
+            if (withWarehouse) {
+                putCsvField(warehouse);
+                buffer.push_back(',');
+            }
+            putCsvField(item.getId());
+            buffer.push_back(',');
+            putCsvField(item.getName());
+            buffer.push_back(',');
+            putCsvField(item.getCategory());
+            buffer.push_back(',');
+            putNumber(item.getQuantity());
+            buffer.push_back(',');
+            putPrice(item.getPriceCents());
+        } else {
+            buffer.push_back('{');
+            if (withWarehouse) {
+                buffer.append("\"warehouse\":");
+                putJsonString(warehouse);
+                buffer.push_back(',');
+            }
+            buffer.append("\"id\":");
+            putJsonString(item.getId());
+            buffer.append(",\"name\":");
+            putJsonString(item.getName());
+            buffer.append(",\"category\":");
+            putJsonString(item.getCategory());
+            buffer.append(",\"quantity\":");
+            putNumber(item.getQuantity());
+            buffer.append(",\"price\":");
+            putPrice(item.getPriceCents());
+            buffer.push_back('}');
+        }
+        buffer.push_back('\n');
+        exported++;
+
+        if (fd != -1 && buffer.size() + MAX_RECORD_SIZE > BUFFER_SIZE) flush();
+    }
+
+    // Writes out whatever is buffered; returns false if any write failed
+    bool finish() {
+        flush();
+        return ok;
+    }
+
+    long long count() const { return exported; }
+
+    // Everything formatted so far, when there is no file descriptor
+    const string& contents() const { return buffer; }
+
+    // Hands over everything formatted so far and starts again with an empty buffer
+    string takeContents() {
+        string text = move(buffer);
+        buffer = string();
+        buffer.reserve(BUFFER_SIZE);
+        return text;
+    }
+};
+
+// Reads one CSV record starting at pos into fields and moves pos past it. Quoted fields may
+// contain separators, doubled quotes and line breaks. Returns false at the end of the data.
+bool readCsvRecord(string_view data, size_t& pos, vector<string>& fields) {
+    fields.clear();
+    if (pos >= data.size()) return false;
+
+    string field;
+    bool quoted = false;
+    for (; pos < data.size(); pos++) {
+        char c = data[pos];
+        if (quoted) {
+            if (c != '"') {
+                field.push_back(c);
+            } else if (pos + 1 < data.size() && data[pos + 1] == '"') {
+                field.push_back('"');
+                pos++;
+            } else {
+                quoted = false;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            fields.push_back(move(field));
+            field.clear();
+        } else if (c == '\n') {
+            pos++;
+            break;
+        } else if (c != '\r') {
+            field.push_back(c);
+        }
+    }
+    fields.push_back(move(field));
+    return true;
+}
+
+// One item to export and the warehouse it comes from
+struct ExportRow {
+    const Item *item;
+    string_view warehouse;
+};
+
+// Exports run on several threads, each formatting one contiguous slice of the rows. Slices
+// smaller than this are not worth a thread.
+constexpr size_t MIN_EXPORT_ROWS_PER_THREAD = 10000;
+
+// Rows an ordered export hands from a formatting thread to the writer at a time; a chunk of
+// worst-case records still fits one exporter buffer
+constexpr size_t EXPORT_CHUNK_ROWS = 2048;
+
+// Writes every row to one file descriptor, in order. With a single thread the rows stream
+// straight through one exporter. Otherwise the rows are cut into chunks dealt round-robin to
+// the threads; each thread formats its next chunk while the previous one waits in its slot,
+// and the writer takes the slots in chunk order. So the output is the same as a
+// single-threaded export, and at most two chunks per thread are held in memory.
+// Returns false if a write failed.
+bool exportOrdered(const vector<ExportRow>& rows, ItemExporter::Format format, bool withWarehouse, int fd) {
+    size_t threads = max<size_t>(1, min<size_t>(thread::hardware_concurrency(), rows.size() / MIN_EXPORT_ROWS_PER_THREAD));
+
+    ItemExporter output(fd, format, withWarehouse);  // Writes the header, if any
+    if (threads == 1) {
+        for (auto &row : rows) output.write(*row.item, row.warehouse);
+        return output.finish();
+    }
+
+    struct Slot {
+        mutex lock;
+        condition_variable changed;
+        string text;
+        bool full = false;
+    };
+    vector<Slot> slots(threads);
+    atomic<bool> abandoned{false};  // The writer failed; formatting the rest is pointless
+    size_t chunks = (rows.size() + EXPORT_CHUNK_ROWS - 1) / EXPORT_CHUNK_ROWS;
+
+    vector<thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            ItemExporter formatter(-1, format, withWarehouse, false);
+            for (size_t c = t; c < chunks && !abandoned; c += threads) {
+                for (size_t r = c * EXPORT_CHUNK_ROWS; r < min(rows.size(), (c + 1) * EXPORT_CHUNK_ROWS); r++) {
+                    formatter.write(*rows[r].item, rows[r].warehouse);
+                }
+
+                unique_lock<mutex> lock(slots[t].lock);
+                slots[t].changed.wait(lock, [&]() { return !slots[t].full || abandoned; });
+                slots[t].text = formatter.takeContents();
+                slots[t].full = true;
+                slots[t].changed.notify_all();
+            }
+        });
+    }
+
+    bool ok = output.finish();
+    for (size_t c = 0; ok && c < chunks; c++) {
+        Slot &slot = slots[c % threads];
+        string text;
+        {
+            unique_lock<mutex> lock(slot.lock);
+            slot.changed.wait(lock, [&]() { return slot.full; });
+            text = move(slot.text);
+            slot.full = false;
+            slot.changed.notify_all();
+        }
+
+        for (size_t written = 0; ok && written < text.size();) {
+            ssize_t n = ::write(fd, text.data() + written, text.size() - written);
+            if (n == -1 && errno == EINTR) continue;
+            if (n <= 0) ok = false;
+            else written += n;
+        }
+    }
+
+    if (!ok) {
+        abandoned = true;
+        for (auto &slot : slots) {
+            lock_guard<mutex> lock(slot.lock);
+            slot.changed.notify_all();
+        }
+    }
+    for (auto &worker : workers) worker.join();
+    return ok;
+}
+
+// Name of one shard file: the shard number goes before the extension (items.csv -> items-2.csv)
+string shardPath(const string& path, int shard) {
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of('/');
+    if (dot == string::npos || (slash != string::npos && dot < slash)) dot = path.size();
+    return path.substr(0, dot) + "-" + to_string(shard) + path.substr(dot);
+}
+
+// Most files a sharded export may be split into: each one gets a thread and a file descriptor
+int maxExportShards() {
+    return max(1u, thread::hardware_concurrency()) * 4;
+}
+
+// Splits the rows into the given number of files, each written by its own thread with its own
+// header. Returns false if a file could not be opened or written.
+bool exportToShards(const vector<ExportRow>& rows, ItemExporter::Format format, bool withWarehouse,
+                    const string& path, int shards) {
+    vector<char> ok(shards, false);
+    vector<thread> workers;
+
+    for (int t = 0; t < shards; t++) {
+        workers.emplace_back([&, t]() {
+            int fd = ::open(shardPath(path, t + 1).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd == -1) return;
+
+            ItemExporter exporter(fd, format, withWarehouse);
+            for (size_t r = rows.size() * t / shards; r < rows.size() * (t + 1) / shards; r++) {
+                exporter.write(*rows[r].item, rows[r].warehouse);
+            }
+            ok[t] = exporter.finish();
+            ::close(fd);
+        });
+    }
+    for (auto &worker : workers) worker.join();
+    return std::find(ok.begin(), ok.end(), false) == ok.end();
+}
+
+// On-disk persistence as a base snapshot plus incremental checkpoints.
+//   <path>.snap          full snapshot: "INVS", generation, item count, items
+//   <path>.delta         checkpoints appended since the last merge; each block is "INVD",
+//                        generation, an entry count, then 'U' + item (added/changed) or
+//                        'D' + ID (removed)
+//   <path>.delta.merging checkpoints being folded into a new snapshot by the merge thread
+//   <path>.delta.old     checkpoints superseded by a full snapshot that is being written
+// Saving appends only what changed, so its cost follows the change rate. Once the deltas
+// outgrow the snapshot, a background thread folds them into a new base snapshot.
+// Every full snapshot starts a new generation; checkpoint blocks from older generations are
+// already contained in it and are skipped when loading. The set-aside files are always older
+// than .delta, and .delta.merging older than .delta.old, so they are replayed in that order.
+class CheckpointStore {
+private:
+    string basePath;
+    mutex fileMutex;        // Serializes renames against appends
+    thread backgroundWriter; // Merge or snapshot currently being written, if any
+    atomic<bool> backgroundFailed{false};  // The last merge or snapshot could not be written
+    atomic<uint32_t> generation{0};       // Generation of the snapshot on disk
+    atomic<uint32_t> blockGeneration{0};  // Stamped on new checkpoints; one ahead while a snapshot is written
+
+    static constexpr uint32_t SNAPSHOT_MAGIC = 0x534e5649;    // "INVS"
+    static constexpr uint32_t CHECKPOINT_MAGIC = 0x444e5649;  // "INVD"
+    static constexpr long long MIN_MERGE_BYTES = 64 * 1024;   // Never merge deltas smaller than this
+
+    // Folds a file of checkpoint blocks into the item list, skipping blocks older than
+    // minGeneration; stops at a torn trailing block. Returns false (with the reason in error)
+    // if it had to stop at a complete block holding an invalid record.
+    static bool applyCheckpoints(string_view data, vector<Item>& items, uint32_t minGeneration, string& error) {
+        unordered_map<string, size_t> positions;
+        for (size_t i = 0; i < items.size(); i++) positions[string(items[i].getId())] = i;
+        vector<bool> removed(items.size(), false);
+
+        RecordReader reader(data.data(), data.size());
+        while (!reader.atEnd()) {
+            if (reader.getUint32() != CHECKPOINT_MAGIC) break;
+            uint32_t blockGeneration = reader.getUint32();
+            uint32_t count = reader.getUint32();
+
+            // Decode the whole block first so a partially written block is ignored entirely
+            vector<pair<bool, Item>> entries;
+            for (uint32_t e = 0; e < count && reader.ok; e++) {
+                uint8_t op = reader.getByte();
+                if (op == 'U') entries.push_back({true, reader.getItem()});
+                else entries.push_back({false, Item(reader.getId())});
+            }
+            if (!reader.ok) {
+                error = reader.error;
+                break;
+            }
+            if (blockGeneration < minGeneration) continue;  // Already part of the snapshot
+
+            for (auto &entry : entries) {
+                auto it = positions.find(string(entry.second.getId()));
+                if (entry.first) {
+                    if (it == positions.end()) {
+                        positions[string(entry.second.getId())] = items.size();
+                        items.push_back(entry.second);
+                        removed.push_back(false);
+                    } else {
+                        items[it->second] = entry.second;
+                        removed[it->second] = false;
+                    }
+                } else if (it != positions.end()) {
+                    removed[it->second] = true;
+                }
+            }
+        }
+
+        vector<Item> kept;
+        for (size_t i = 0; i < items.size(); i++) {
+            if (!removed[i]) kept.push_back(items[i]);
+        }
+        items.swap(kept);
+        return error.empty();
+    }
+
+    // Reads a snapshot into items and returns its generation (0 if there is none). error is
+    // set if it holds an invalid record; the items before it are read.
+    static uint32_t readSnapshot(const string& path, vector<Item>& items, string& error) {
+        MappedFile file;
+        if (!file.open(path)) return 0;
+
+        string_view data = file.contents();
+        RecordReader reader(data.data(), data.size());
+        if (reader.getUint32() != SNAPSHOT_MAGIC) return 0;
+
+        uint32_t snapshotGeneration = reader.getUint32();
+        uint32_t count = reader.getUint32();
+        for (uint32_t i = 0; i < count; i++) {
+            Item item = reader.getItem();
+            if (!reader.ok) break;
+            items.push_back(item);
+        }
+        error = reader.error;
+        return snapshotGeneration;
+    }
+
+    // Writes data to the file (appended or replacing it) and waits until it is on the disk.
+    // A failed append is cut off again so no torn block is left in front of later ones.
+    static bool writeDurably(const string& path, const string& data, bool append) {
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+        if (fd == -1) return false;
+
+        struct stat info;
+        off_t originalSize = (append && fstat(fd, &info) == 0) ? info.st_size : 0;
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t written = ::write(fd, data.data() + done, data.size() - done);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) break;
+            done += written;
+        }
+
+        bool ok = done == data.size() && fsync(fd) == 0;
+        if (!ok && append) ftruncate(fd, originalSize);
+        return ::close(fd) == 0 && ok;
+    }
+
+    // Encodes a complete snapshot in one buffer, writes it next to the old one with a single
+    // sequential write, then atomically replaces the old one. Returns false (and leaves the
+    // old snapshot in place) if the new one could not be written completely.
+    bool replaceSnapshot(const vector<Item>& items, uint32_t snapshotGeneration) {
+        RecordWriter writer;
+        writer.buffer.reserve(64 * items.size());
+        writer.putUint32(SNAPSHOT_MAGIC);
+        writer.putUint32(snapshotGeneration);
+        writer.putUint32(items.size());
+        for (auto &item : items) writer.putItem(item);
+
+        if (!writeDurably(snapshotPath() + ".tmp", writer.buffer, false)) {
+            remove((snapshotPath() + ".tmp").c_str());
+            return false;
+        }
+        lock_guard<mutex> lock(fileMutex);
+        return rename((snapshotPath() + ".tmp").c_str(), snapshotPath().c_str()) == 0;
+    }
+
+    // Merge thread body: snapshot + frozen deltas (and deltas left by a failed snapshot, which
+    // are newer) -> new snapshot of the same generation
+    void mergeDeltas(uint32_t mergeGeneration) {
+        vector<Item> items;
+
+        string error;
+        uint32_t snapshotGeneration = readSnapshot(snapshotPath(), items, error);
+        for (auto &path : {mergingPath(), supersededPath()}) {
+            MappedFile file;
+            if (error.empty() && file.open(path)) {
+                applyCheckpoints(file.contents(), items, snapshotGeneration, error);
+            }
+        }
+
+        // The frozen deltas stay until the snapshot holding them is safely in place; an
+        // unreadable record means the merge would drop whatever follows it
+        if (!error.empty() || !replaceSnapshot(items, mergeGeneration)) {
+            backgroundFailed = true;
+            return;
+        }
+        lock_guard<mutex> lock(fileMutex);
+        remove(mergingPath().c_str());
+        remove(supersededPath().c_str());
+    }
+
+    // Appends one file to another and removes it. Returns false if that failed; the source is
+    // then still in place (a missing source counts as done).
+    static bool appendAndRemove(const string& from, const string& to) {
+        MappedFile source;
+        if (!source.open(from)) return !fileExists(from);
+        if (!writeDurably(to, string(source.contents()), true)) return false;
+        source.close();
+        return remove(from.c_str()) == 0;
+    }
+
+    static long long fileSize(const string& path) {
+        ifstream file(path, ios::binary | ios::ate);
+        return file ? (long long) file.tellg() : 0;
+    }
+
+    static bool fileExists(const string& path) {
+        return (bool) ifstream(path);
+    }
+
+public:
+    explicit CheckpointStore(const string& path) : basePath(path) {}
+
+    ~CheckpointStore() {
+        waitForBackgroundWriter();
+    }
+
+    string snapshotPath() const { return basePath + ".snap"; }
+    string deltaPath() const { return basePath + ".delta"; }
+    string mergingPath() const { return basePath + ".delta.merging"; }
+    string supersededPath() const { return basePath + ".delta.old"; }
+    string itemFilePath() const { return basePath + ".items"; }  // Live item table (mapped storage)
+
+    // Blocks until a background merge or snapshot has reached the disk
+    void waitForBackgroundWriter() {
+        if (backgroundWriter.joinable()) backgroundWriter.join();
+    }
+
+    // Reconstructs the latest item list: snapshot, then any deltas in the order they were written
+    vector<Item> load() {
+        vector<Item> items;
+        MappedFile file;
+
+        string error;
+        waitForBackgroundWriter();
+        generation = readSnapshot(snapshotPath(), items, error);
+        blockGeneration = generation.load();
+        if (!error.empty()) cerr << snapshotPath() << ": " << error << ". The items after it were not loaded.\n";
+        for (auto &path : {mergingPath(), supersededPath(), deltaPath()}) {
+            error.clear();
+            if (file.open(path) && !applyCheckpoints(file.contents(), items, generation, error)) {
+                cerr << path << ": " << error << ". The checkpoints from there on were not loaded.\n";
+            }
+        }
+        return items;
+    }
+
+    // Appends one checkpoint block, then starts a background merge if the deltas have grown
+    // larger than the snapshot. Returns false if the block did not reach the disk.
+    bool appendCheckpoint(const string& block) {
+        {
+            lock_guard<mutex> lock(fileMutex);
+            if (!writeDurably(deltaPath(), block, true)) return false;
+        }
+
+        long long deltaBytes = fileSize(deltaPath());
+        if (deltaBytes > max(MIN_MERGE_BYTES, fileSize(snapshotPath()))) {
+            startMerge();
+        }
+        return true;
+    }
+
+    // Whether a merge or snapshot failed since the last call; its input files were kept
+    bool takeBackgroundFailure() {
+        return backgroundFailed.exchange(false);
+    }
+
+    // Freezes the current deltas and folds them into a new snapshot on a background thread;
+    // checkpoints written meanwhile go to a fresh delta file
+    void startMerge() {
+        waitForBackgroundWriter();
+
+        {
+            lock_guard<mutex> lock(fileMutex);
+            // A leftover .merging file (interrupted merge) is folded first, without the newer
+            // .delta. Otherwise deltas left by a failed snapshot are older than .delta and
+            // become the start of the merging file, so .delta.old is only ever newer than it.
+            if (!fileExists(mergingPath())) {
+                if (fileExists(supersededPath())) {
+                    rename(supersededPath().c_str(), mergingPath().c_str());
+                    if (!appendAndRemove(deltaPath(), mergingPath())) return;  // Still in .delta
+                } else {
+                    rename(deltaPath().c_str(), mergingPath().c_str());
+                }
+            }
+        }
+        backgroundWriter = thread(&CheckpointStore::mergeDeltas, this, generation.load());
+    }
+
+    // Writes an already captured copy of the items as the new snapshot on a background
+    // thread; only encoding and writing happen there. A merge or snapshot still running is
+    // waited for first, so the call can block for as long as that takes. Deltas written so far
+    // are set aside and dropped once the snapshot is in place; later checkpoints belong to the
+    // new generation and go to a fresh delta file. The generation only advances once the
+    // snapshot has landed; after a failure new checkpoints carry the old one again.
+    void writeSnapshotAsync(vector<Item> items) {
+        waitForBackgroundWriter();
+
+        uint32_t snapshotGeneration;
+        {
+            lock_guard<mutex> lock(fileMutex);
+            // Deltas left by a snapshot that failed are still needed; the new ones go after them
+            bool setAside = fileExists(supersededPath()) ? appendAndRemove(deltaPath(), supersededPath())
+                                                         : rename(deltaPath().c_str(), supersededPath().c_str()) == 0 ||
+                                                           !fileExists(deltaPath());
+            if (!setAside) {
+                backgroundFailed = true;  // The snapshot would outrank deltas still in .delta
+                return;
+            }
+            snapshotGeneration = generation + 1;
+            blockGeneration = snapshotGeneration;
+        }
+
+        backgroundWriter = thread([this, snapshotGeneration, captured = move(items)]() {
+            if (!replaceSnapshot(captured, snapshotGeneration)) {
+                blockGeneration = generation.load();
+                backgroundFailed = true;  // Old snapshot and set-aside deltas still hold everything
+                return;
+            }
+
+            lock_guard<mutex> lock(fileMutex);
+            generation = snapshotGeneration;
+            remove(supersededPath().c_str());
+            remove(mergingPath().c_str());
+        });
+    }
+
+    // Header of a checkpoint block holding count entries
+    string checkpointHeader(uint32_t count) const {
+        RecordWriter writer;
+        writer.putUint32(CHECKPOINT_MAGIC);
+        writer.putUint32(blockGeneration);
+        writer.putUint32(count);
+        return writer.buffer;
+    }
+};
+
+// Bloom filter over item IDs, checked before the ID hash map. An ID the filter has never seen
+// is rejected after probing a few bits of one small array, without touching the hash map,
+// which is the common case when a bulk import checks new IDs for duplicates. A "maybe" answer
+// still goes to the hash map, so false positives only cost time. Removed IDs cannot be
+// cleared from the bits; the owner rebuilds the filter once enough of them pile up.
+// The size follows the configured capacity and false-positive rate:
+// bits = -n ln p / (ln 2)^2, hash functions = bits / n * ln 2.
+class IdFilter {
+private:
+    vector<uint64_t> bits;
+    size_t bitCount = 0;
+    int hashCount = 0;
+    size_t capacity = 0;
+    double targetRate = 0.01;
+    size_t inserted = 0;
+
+    static uint64_t hash(string_view id) {
+        uint64_t h = 1469598103934665603ULL;  // FNV-1a
+        for (char c : id) {
+            h ^= (unsigned char) c;
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    // Double hashing: probe i is h1 + i * h2, with h2 odd so the probes never collapse
+    template<typename Visit>
+    void forEachProbe(string_view id, Visit visit) const {
+        uint64_t h1 = hash(id);
+        uint64_t h2 = ((h1 >> 33) ^ (h1 * 0x9e3779b97f4a7c15ULL)) | 1;
+        for (int i = 0; i < hashCount; i++) {
+            if (!visit((h1 + i * h2) % bitCount)) return;
+        }
+    }
+
+public:
+    static constexpr double MIN_RATE = 1e-6;  // About 29 bits per ID
+    static constexpr double MAX_RATE = 0.5;
+    static constexpr size_t MAX_BITS = 1ULL << 32;  // 512 MB; past this the rate just gets worse
+
+    mutable atomic<long long> definitelyNew{0};   // Lookups answered by the filter alone
+    mutable atomic<long long> falsePositives{0};  // "Maybe" answers the hash map turned down
+
+    // Sizes the filter for the given number of IDs and false-positive rate and empties it.
+    // Rates outside [MIN_RATE, MAX_RATE] are clamped (a non-finite one means the default).
+    void configure(size_t expectedIds, double falsePositiveRate) {
+        capacity = max<size_t>(expectedIds, 1);
+        targetRate = isfinite(falsePositiveRate) ? clamp(falsePositiveRate, MIN_RATE, MAX_RATE) : 0.01;
+
+        double ln2 = log(2.0);
+        double wantedBits = ceil(-(double) capacity * log(targetRate) / (ln2 * ln2));
+        bitCount = (size_t) clamp(wantedBits, 64.0, (double) MAX_BITS);
+        hashCount = max(1, (int) lround((double) bitCount / capacity * ln2));
+        bits.assign((bitCount + 63) / 64, 0);
+        inserted = 0;
+    }
+
+    void insert(string_view id) {
+        forEachProbe(id, [&](size_t bit) {
+            bits[bit / 64] |= 1ULL << (bit % 64);
+            return true;
+        });
+        inserted++;
+    }
+
+    // False means the ID was never inserted; true means it may have been
+    bool mayContain(string_view id) const {
+        bool found = true;
+        forEachProbe(id, [&](size_t bit) {
+            found = (bits[bit / 64] >> (bit % 64)) & 1;
+            return found;
+        });
+        return found;
+    }
+
+    // Expected false-positive rate with the IDs inserted so far: (1 - e^(-k n / m))^k
+    double estimatedRate() const {
+        return pow(1 - exp(-(double) hashCount * inserted / bitCount), hashCount);
+    }
+
+    size_t memoryBytes() const { return bits.size() * sizeof(uint64_t); }
+    size_t bitSize() const { return bitCount; }
+    int hashFunctions() const { return hashCount; }
+    size_t insertedIds() const { return inserted; }
+    size_t expectedIds() const { return capacity; }
+    double configuredRate() const { return targetRate; }
+};
+
+// Base Inventory class
+class BaseInventory {
+public:
+    virtual void addItem() = 0;
+    virtual void updateItem() = 0;
+    virtual void removeItem() = 0;
+    virtual void displayItemsByCategory() = 0;
+    virtual void displayAllItems() = 0;
+    virtual void searchItem() = 0;
+    virtual void sortItems() = 0;
+    virtual void displayLowStockItems() = 0;
+    virtual void fuzzySearchByName() = 0;
+    virtual void rangeQuery() = 0;
+    virtual void displaySummary() = 0;
+    virtual void displayTopItems() = 0;
+    virtual void browseItems() = 0;
+    virtual void adjustStock() = 0;
+    virtual void receiveShipment() = 0;
+    virtual void saveCheckpoint() = 0;
+    virtual void saveSnapshot() = 0;
+    virtual void filterItems() = 0;
+    virtual void exportItems() = 0;
+    virtual void importItems() = 0;
+    virtual void configureIdFilter() = 0;
+    virtual void configureStorageSync() = 0;
+};
+
+// Storage policies for the inventory's item records. Every layout keeps the records
+// contiguous, so the indexes, sorts, filters and exporters keep working on plain Item
+// pointers, and the inventory calls its policy directly (resolved at compile time, no
+// virtual calls on the item access paths).
+template<typename S>
+concept ItemStorage = requires(S storage, const S constStorage, int n) {
+    { storage[n] } -> same_as<Item&>;
+    { constStorage[n] } -> same_as<const Item&>;
+    { storage.data() } -> same_as<Item*>;
+    { constStorage.data() } -> same_as<const Item*>;
+    { constStorage.capacity() } -> convertible_to<int>;
+    { storage.reserve(n) } -> same_as<bool>;  // Room for n records; false if the storage is full
+};
+
+// Records in a fixed array inside the inventory: no allocation, fixed capacity
+template<int Capacity>
+class FixedItemArray {
+private:
+    Item records[Capacity];
+
+public:
+    Item& operator[](int i) { return records[i]; }
+    const Item& operator[](int i) const { return records[i]; }
+    Item* data() { return records; }
+    const Item* data() const { return records; }
+    int capacity() const { return Capacity; }
+    bool reserve(int count) const { return count <= Capacity; }
+};
+
+// Records in a vector that doubles when it runs out of room, for inventories without a
+// fixed size. Growing moves the records, so references into it only last until the next add.
+class GrowableItemVector {
+private:
+    static constexpr int INITIAL_CAPACITY = 128;
+    vector<Item> records;
+
+public:
+    Item& operator[](int i) { return records[i]; }
+    const Item& operator[](int i) const { return records[i]; }
+    Item* data() { return records.data(); }
+    const Item* data() const { return records.data(); }
+    int capacity() const { return max<int>(records.size(), INITIAL_CAPACITY); }
+
+    bool reserve(int count) {
+        if (count > (int) records.size()) {
+            records.resize(max<int>(count, records.empty() ? INITIAL_CAPACITY : records.size() * 2));
+        }
+        return true;
+    }
+};
+
+// Storage that is itself the persistent copy of the items, so there is nothing to load or save
+template<typename S>
+concept PersistentItemStorage = ItemStorage<S> && requires(S storage, const S constStorage, const string& path,
+                                                          bool& created, int n) {
+    { storage.open(path, created) } -> same_as<int>;  // Records already stored, or -1 if unusable
+    { constStorage.isOpen() } -> same_as<bool>;
+    storage.setCount(n);                    // Records 0..n-1 are the current items
+    storage.changed();                      // Some record was written in place
+    storage.beginMove();                    // Records are about to be moved around in place
+    storage.endMove();                      // ... and have been
+    { constStorage.syncPending() } -> same_as<bool>;  // Written since the last successful sync()
+    { storage.sync() } -> same_as<bool>;    // Flush what the sync policy leaves to saving
+};
+
+// Records in a file mapped into memory: the item table is the file, so an update is a store
+// into the mapping, adding past the end extends the file, and startup maps it instead of
+// reading and decoding it. Until a file is opened the records live in an anonymous mapping.
+//
+// File layout: a 64-byte header, a table of the category names the stored category IDs
+// stand for (so IDs survive changes to categories.txt), then the records.
+//
+// Other processes may read the file while it is open here (see read()). Removals and sorts
+// move records in place, so they are bracketed by a generation counter in the header, odd
+// while a move is in progress: a reader retries until its copy was taken between moves.
+class MappedItemFile {
+public:
+    // When changed pages are written to the disk explicitly
+    enum class SyncPolicy : uint32_t {
+        Kernel,      // Never: the kernel writes them back on its own (survives a crash, not a power loss)
+        OnSave,      // When the inventory is saved (Save Changes, exit)
+        EveryChange  // After every add, update and removal
+    };
+
+private:
+    static constexpr uint32_t MAGIC = 0x4d4e5649;  // "INVM"
+    static constexpr int INITIAL_CAPACITY = 128;
+    static constexpr int MAX_READ_ATTEMPTS = 1000;  // Copies read() tries before giving up
+    static constexpr int CATEGORY_NAME_SIZE = CategoryRegistry::MAX_NAME_LENGTH + 1;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t recordSize;    // sizeof(Item) of the build that created the file
+        int32_t count;          // Records in use
+        int32_t categoryCount;  // Entries of the category table in use
+        uint32_t syncPolicy;
+        uint32_t generation;    // Bumped before and after records are moved in place
+        char reserved[40];
+    };
+    static_assert(sizeof(Header) == 64);
+
+    static constexpr size_t CATEGORY_TABLE_OFFSET = sizeof(Header);
+    static constexpr size_t RECORDS_OFFSET = CATEGORY_TABLE_OFFSET +
+                                             CategoryRegistry::MAX_CATEGORIES * CATEGORY_NAME_SIZE;
+
+    int fd = -1;               // -1 while the records are in an anonymous mapping
+    char *mapping = nullptr;
+    size_t mappedSize = 0;
+    int recordCapacity = 0;
+    bool pendingSync = false;  // Written since the last successful msync()
+
+    static size_t fileSize(int capacity) { return RECORDS_OFFSET + (size_t) capacity * sizeof(Item); }
+
+    Header& header() const { return *(Header*) mapping; }
+    Item* records() const { return (Item*) (mapping + RECORDS_OFFSET); }
+
+    // The header's generation counter, shared with readers in other processes
+    static atomic_ref<uint32_t> generation(const char *data) {
+        return atomic_ref<uint32_t>(const_cast<Header*>((const Header*) data)->generation);
+    }
+
+    // Checks that a mapped file of the given size holds a table this build can use, down to
+    // every record in use (the bytes come straight from disk, with nothing decoded)
+    static bool valid(const char *data, size_t size) {
+        if (size < RECORDS_OFFSET) return false;
+        const Header &stored = *(const Header*) data;
+        if (stored.magic != MAGIC || stored.recordSize != sizeof(Item) || stored.count < 0 ||
+            (size_t) stored.count > (size - RECORDS_OFFSET) / sizeof(Item) ||
+            stored.categoryCount < 0 || stored.categoryCount > CategoryRegistry::MAX_CATEGORIES) {
+            return false;
+        }
+
+        const Item *records = (const Item*) (data + RECORDS_OFFSET);
+        for (int i = 0; i < stored.count; i++) {
+            if (!records[i].wellFormed(stored.categoryCount)) return false;
+        }
+        return true;
+    }
+
+    // Stored category ID -> ID in this run's registry, for the categories named in the table.
+    // Returns false if one of them cannot be registered in this run.
+    static bool categoryTranslation(const char *data, vector<uint8_t>& translation) {
+        const Header &stored = *(const Header*) data;
+        translation.assign(CategoryRegistry::MAX_CATEGORIES, 0);
+        for (int id = 0; id < CategoryRegistry::MAX_CATEGORIES; id++) {
+            if (id < stored.categoryCount) {
+                const char *name = data + CATEGORY_TABLE_OFFSET + id * CATEGORY_NAME_SIZE;
+                int registered = categories.findOrAdd(string(name, strnlen(name, CATEGORY_NAME_SIZE)));
+                if (registered == -1) return false;
+                translation[id] = registered;
+            } else {
+                translation[id] = id < categories.size() ? id : 0;
+            }
+        }
+        return true;
+    }
+
+    // Writes this run's category names into the table
+    void writeCategories() {
+        for (int id = 0; id < categories.size(); id++) {
+            char *entry = mapping + CATEGORY_TABLE_OFFSET + id * CATEGORY_NAME_SIZE;
+            size_t length = min<size_t>(categories.name(id).size(), CATEGORY_NAME_SIZE - 1);
+            memcpy(entry, categories.name(id).data(), length);
+            memset(entry + length, 0, CATEGORY_NAME_SIZE - length);
+        }
+        header().categoryCount = categories.size();
+    }
+
+    // Moves the mapping to room for the given number of records, extending the file first
+    bool remap(int capacity) {
+        size_t size = fileSize(capacity);
+        if (fd != -1 && ftruncate(fd, size) != 0) return false;
+
+        void *moved = (mapping == nullptr)
+                      ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+                      : mremap(mapping, mappedSize, size, MREMAP_MAYMOVE);
+        if (moved == MAP_FAILED) return false;
+
+        mapping = (char*) moved;
+        mappedSize = size;
+        recordCapacity = capacity;
+        return true;
+    }
+
+    void unmap() {
+        if (mapping != nullptr) munmap(mapping, mappedSize);
+        if (fd != -1) ::close(fd);
+        mapping = nullptr;
+        mappedSize = 0;
+        fd = -1;
+    }
+
+public:
+    MappedItemFile() {
+        if (!remap(INITIAL_CAPACITY)) throw bad_alloc();
+        header() = Header{MAGIC, sizeof(Item), 0, 0, (uint32_t) SyncPolicy::OnSave, 0, {}};
+    }
+    MappedItemFile(const MappedItemFile&) = delete;
+    MappedItemFile& operator=(const MappedItemFile&) = delete;
+
+    ~MappedItemFile() { unmap(); }
+
+    Item& operator[](int i) { return records()[i]; }
+    const Item& operator[](int i) const { return records()[i]; }
+    Item* data() { return records(); }
+    const Item* data() const { return records(); }
+    int capacity() const { return recordCapacity; }
+
+    // Grows by doubling. Growing may move the mapping, so references into it only last until
+    // the next add.
+    bool reserve(int count) {
+        return count <= recordCapacity || remap(max(count, recordCapacity * 2));
+    }
+
+    // Maps the item file at path (created if missing) in place of the current records, which
+    // are dropped. Returns the number of records stored in it, or -1 if it cannot be used.
+    int open(const string& path, bool& created) {
+        int file = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (file == -1) return -1;
+
+        struct stat info;
+        if (fstat(file, &info) != 0) {
+            ::close(file);
+            return -1;
+        }
+        created = info.st_size == 0;
+        size_t size = created ? fileSize(INITIAL_CAPACITY) : info.st_size;
+
+        void *fileMapping = MAP_FAILED;
+        if (!created || ftruncate(file, size) == 0) {
+            fileMapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        }
+        vector<uint8_t> translation;
+        if (fileMapping == MAP_FAILED || (!created && (!valid((const char*) fileMapping, size) ||
+                                                       !categoryTranslation((const char*) fileMapping, translation)))) {
+            if (fileMapping != MAP_FAILED) munmap(fileMapping, size);
+            ::close(file);
+            return -1;
+        }
+
+        uint32_t policy = header().syncPolicy;
+        unmap();
+        fd = file;
+        mapping = (char*) fileMapping;
+        mappedSize = size;
+        recordCapacity = (size - RECORDS_OFFSET) / sizeof(Item);
+
+        if (created) {
+            header() = Header{MAGIC, sizeof(Item), 0, 0, policy, 0, {}};
+        } else {
+            // Rewrite the category IDs only if this run numbers the categories differently
+            for (int id = 0; id < header().categoryCount; id++) {
+                if (translation[id] == id) continue;
+                beginMove();
+                for (int i = 0; i < header().count; i++) {
+                    records()[i].setCategoryId(translation[records()[i].getCategoryId()]);
+                }
+                endMove();
+                break;
+            }
+        }
+        writeCategories();
+        pendingSync = true;  // The header and category table at least
+        return header().count;
+    }
+
+    bool isOpen() const { return fd != -1; }
+
+    void setCount(int count) { header().count = count; }
+
+    // Not thread-safe: the inventory calls it under its own lock
+    void changed() {
+        if (header().categoryCount != categories.size()) writeCategories();  // A category was added
+        pendingSync = true;
+        if (isOpen() && syncPolicy() == SyncPolicy::EveryChange) sync();  // A failure stays pending for saving
+    }
+
+    void beginMove() { generation(mapping)++; }
+    void endMove() { generation(mapping)++; }
+
+    bool syncPending() const { return isOpen() && pendingSync; }
+
+    bool sync() {
+        if (!isOpen() || syncPolicy() == SyncPolicy::Kernel) {
+            pendingSync = false;
+            return true;
+        }
+        if (msync(mapping, mappedSize, MS_SYNC) != 0) return false;
+        pendingSync = false;
+        return true;
+    }
+
+    // The policy is kept in the file, so it stays in effect for later runs
+    SyncPolicy syncPolicy() const { return (SyncPolicy) header().syncPolicy; }
+    void setSyncPolicy(SyncPolicy policy) { header().syncPolicy = (uint32_t) policy; }
+
+    // Reads the records of an item file without mapping it for writing, e.g. while another
+    // process has it open; returns false if it is missing or cannot be used. The file is
+    // copied out first, again if the other process moved records during the copy.
+    static bool read(const string& path, vector<Item>& items) {
+        MappedFile file;
+        if (!file.open(path) || file.contents().size() < sizeof(Header)) return false;
+
+        string copy;
+        for (int attempt = 0;; attempt++) {
+            if (attempt == MAX_READ_ATTEMPTS) return false;
+
+            uint32_t before = generation(file.contents().data()).load();
+            if (before % 2 == 1) {
+                this_thread::yield();
+                continue;
+            }
+            copy.assign(file.contents());
+            atomic_thread_fence(memory_order_acquire);
+            if (generation(file.contents().data()).load() == before) break;
+        }
+        if (!valid(copy.data(), copy.size())) return false;
+
+        const char *data = copy.data();
+        const Item *stored = (const Item*) (data + RECORDS_OFFSET);
+        vector<uint8_t> translation;
+        if (!categoryTranslation(data, translation)) return false;
+        items.assign(stored, stored + ((const Header*) data)->count);
+        for (auto &item : items) item.setCategoryId(translation[item.getCategoryId()]);
+        return true;
+    }
+};
+
+// Class representing the inventory (manages multiple items), with its records kept in the
+// given storage layout
+template<ItemStorage Storage>
+class BasicInventory : public BaseInventory {
+public:
+    Storage items;                     // Item records, indexed by position
+    int itemCount;                     // Track the number of items in inventory
+
+    unordered_map<string, int> idIndex;  // Item ID -> position in items[]
+    NameIndex nameIndex;                 // BK-tree over item names for fuzzy search
+    OrderedIndex<ByPrice> priceIndex;       // Price -> item IDs, for range queries
+    OrderedIndex<ByQuantity> quantityIndex; // Quantity -> item IDs, for range queries
+    OrderedIndex<ByName> nameOrderIndex;    // Name -> item IDs, for paging in name order
+    StockTotals totals;                              // Aggregates over the whole inventory
+    unordered_map<string, StockTotals> categoryTotals;  // Aggregates per category
+    mutex derivedMutex;  // Guards indexes and totals during concurrent adjustQuantity() calls
+    ChangeFeed changeFeed;  // Notifies subscribers of every add, update and removal
+    bool publishingChanges = true;  // Off while replaceItems() reloads the contents
+    unordered_set<string> dirtyIds;  // Items added, changed or removed since the last checkpoint
+    CheckpointStore *store;          // Where checkpoints go (nullptr: not persisted)
+    IdFilter idFilter;                 // Fast "definitely not present" answers for ID lookups
+    int removedSinceFilterBuild = 0;   // Removed IDs still set in idFilter
+    ValueHistogram priceHistogram;     // Price distribution (cents) for the query planner
+    ValueHistogram quantityHistogram;  // Quantity distribution for the query planner
+    atomic<long long> changeCount{0};  // Changes so far, to tell when the histograms are stale
+    long long statisticsBuiltAt = -1;  // changeCount when the histograms were last built
+
+    // One way the planner can produce the rows of an AND-clause
+    struct AccessPath {
+        enum Kind { FullScan, IdLookup, CategoryIndex, IndexRange, BitmapIntersection };
+        Kind kind;
+        vector<int> driving;  // Conditions the access path answers itself
+        double rows;          // Estimated rows it produces, before the other conditions
+        double cost;          // Estimated items and index entries touched
+    };
+
+    // Cost of reaching an item through an index entry, relative to checking it in a scan
+    static constexpr double INDEX_ENTRY_COST = 3;
+
+    static const int LOW_STOCK_THRESHOLD = 5;  // Quantity at or below which an item is low on stock
+
+    // Outcome of an adjustQuantity() call
+    enum class AdjustResult { Applied, NotFound, WouldGoNegative, WouldOverflow };
+
+    // Default target false-positive rate of the ID filter
+    static constexpr double ID_FILTER_FALSE_POSITIVE_RATE = 0.01;
+
+    // Constructor
+    BasicInventory() : itemCount(0), store(nullptr) {
+        idFilter.configure(items.capacity(), ID_FILTER_FALSE_POSITIVE_RATE);
+    }
+
+    // Records a change: marks the item dirty for the next checkpoint and notifies subscribers
+    void recordChange(const ChangeEvent& event) {
+        {
+            // Concurrent adjustQuantity() calls get here together; the storage's header, category
+            // table and sync state are not safe to update from several threads at once
+            lock_guard<mutex> lock(derivedMutex);
+            dirtyIds.insert(event.id);
+            if constexpr (PersistentItemStorage<Storage>) items.changed();
+        }
+        changeCount++;
+        if (publishingChanges) changeFeed.publish(event);
+    }
+
+    // Whether the items are persisted by their storage itself rather than by checkpoints
+    bool persistedInPlace() const {
+        if constexpr (PersistentItemStorage<Storage>) return items.isOpen();
+        else return false;
+    }
+
+    // Loads the inventory persisted in the given store and saves future checkpoints there.
+    // Persistent storage instead maps the store's item file and only indexes the records in
+    // it; a new item file starts from the checkpoints. Returns the number of stored items
+    // that did not fit.
+    int attachStore(CheckpointStore& checkpointStore) {
+        int skipped = 0;
+        store = &checkpointStore;
+
+        if constexpr (PersistentItemStorage<Storage>) {
+            bool created = false;
+            int stored = items.open(checkpointStore.itemFilePath(), created);
+            if (stored == -1) {
+                cout << checkpointStore.itemFilePath() << " cannot be used. Saving through checkpoints instead.\n";
+            } else if (!created) {
+                for (int i = 0; i < stored; i++) indexItem(i);
+                itemCount = stored;
+                if (idFilter.insertedIds() > idFilter.expectedIds()) rebuildIdFilter(idFilter.configuredRate());
+                return 0;
+            }
+        }
+
+        for (auto &item : checkpointStore.load()) {
+            if (!insertItem(item)) skipped++;
+        }
+        dirtyIds.clear();  // Everything loaded is already on disk
+        if constexpr (PersistentItemStorage<Storage>) items.sync();
+        return skipped;
+    }
+
+    // Appends every item changed since the last checkpoint to the store, in one write.
+    // Returns the number of items written, or -1 if writing failed (the changes stay pending).
+    int writeCheckpoint() {
+        if (store == nullptr) return 0;
+
+        // Changes are already in the item file; saving only flushes them (including whole-table
+        // rewrites such as a sort, which leave no item dirty)
+        if constexpr (PersistentItemStorage<Storage>) {
+            if (items.isOpen()) {
+                if (dirtyIds.empty() && !items.syncPending()) return 0;
+                if (!items.sync()) return -1;
+                int written = dirtyIds.size();
+                dirtyIds.clear();
+                return written;
+            }
+        }
+        if (dirtyIds.empty()) return 0;
+
+        RecordWriter writer;
+        writer.buffer = store->checkpointHeader(dirtyIds.size());
+
+        // Removals first, then changed items in storage order so new items reload in place
+        vector<int> positions;
+        for (auto &id : dirtyIds) {
+            int position = findItemIndex(id);
+            if (position == -1) {
+                writer.putByte('D');  // Removed since it was last saved
+                writer.putString(id);
+            } else {
+                positions.push_back(position);
+            }
+        }
+        sort(positions.begin(), positions.end());
+        for (int position : positions) {
+            writer.putByte('U');
+            writer.putItem(items[position]);
+        }
+
+        if (!store->appendCheckpoint(writer.buffer)) return -1;
+        int written = dirtyIds.size();
+        dirtyIds.clear();
+        return written;
+    }
+
+    // Returns the position of the item with the given ID, or -1 if it is not in the inventory
+    int findItemIndex(const string& id) const {
+        if (!idFilter.mayContain(id)) {
+            idFilter.definitelyNew.fetch_add(1, memory_order_relaxed);
+            return -1;
+        }
+
+        auto it = idIndex.find(id);
+        if (it == idIndex.end()) {
+            idFilter.falsePositives.fetch_add(1, memory_order_relaxed);
+            return -1;
+        }
+        return it->second;
+    }
+
+    // Refills the ID filter from the current items, e.g. after removals or a new configuration
+    void rebuildIdFilter(double falsePositiveRate) {
+        idFilter.configure(max(items.capacity(), 2 * itemCount), falsePositiveRate);
+        for (int i = 0; i < itemCount; i++) idFilter.insert(items[i].getId());
+        removedSinceFilterBuild = 0;
+    }
+
+    // Registers the record at the given position in the indexes and totals
+    void indexItem(int position) {
+        const Item &item = items[position];
+        idIndex[string(item.getId())] = position;
+        idFilter.insert(item.getId());
+        nameIndex.insert(item.getName(), item.getId());
+        nameOrderIndex.insert(item);
+        priceIndex.insert(item);
+        quantityIndex.insert(item);
+        totals.apply(item, 1);
+        categoryTotals[item.getCategory()].apply(item, 1);
+    }
+
+    // Appends an item and registers it in the indexes; returns false if the inventory is full
+    bool insertItem(const Item& item) {
+        if (!items.reserve(itemCount + 1)) return false;
+
+        items[itemCount] = item;
+        indexItem(itemCount);
+        itemCount++;
+        if constexpr (PersistentItemStorage<Storage>) items.setCount(itemCount);
+        if (idFilter.insertedIds() > idFilter.expectedIds()) rebuildIdFilter(idFilter.configuredRate());  // Outgrown
+
+        recordChange({ChangeEvent::Added, string(item.getId()), string(item.getName()), item.getCategory(),
+                            0, item.getQuantity(), 0.0, item.getPrice()});
+        return true;
+    }
+
+    // Removes the item at the given position, keeping the remaining items in order
+    void eraseItemAt(int position) {
+        idIndex.erase(string(items[position].getId()));
+        nameIndex.erase(items[position].getName(), items[position].getId());
+        nameOrderIndex.erase(items[position]);
+        priceIndex.erase(items[position]);
+        quantityIndex.erase(items[position]);
+        totals.apply(items[position], -1);
+        categoryTotals[items[position].getCategory()].apply(items[position], -1);
+        ChangeEvent removal{ChangeEvent::Removed, string(items[position].getId()), string(items[position].getName()),
+                            items[position].getCategory(), items[position].getQuantity(), 0,
+                            items[position].getPrice(), 0.0};
+
+        // Shift all items after the removed item to fill the gap
+        if constexpr (PersistentItemStorage<Storage>) items.beginMove();
+        for (int j = position; j < itemCount - 1; j++) {
+            items[j] = items[j + 1];
+            idIndex[string(items[j].getId())] = j;
+        }
+        itemCount--;
+        if constexpr (PersistentItemStorage<Storage>) {
+            items.setCount(itemCount);
+            items.endMove();
+        }
+        recordChange(removal);  // After the shift, so a storage syncing every change sees it done
+
+        // Removed IDs stay set in the filter; once they would noticeably raise its
+        // false-positive rate, start over from the items that are left
+        if (++removedSinceFilterBuild > (int) idFilter.expectedIds() / 4) rebuildIdFilter(idFilter.configuredRate());
+    }
+
+    // Replaces every item without notifying subscribers: the new contents are a state that was
+    // already reported (a replica catching up), not a series of new changes
+    void replaceItems(const vector<Item>& replacement) {
+        publishingChanges = false;
+        while (itemCount > 0) eraseItemAt(itemCount - 1);
+        for (auto &item : replacement) insertItem(item);
+        publishingChanges = true;
+    }
+
+    // Tells subscribers that an item's quantity and/or price changed
+    void publishUpdate(const Item& item, int oldQuantity, double oldPrice) {
+        recordChange({ChangeEvent::Updated, string(item.getId()), string(item.getName()), item.getCategory(),
+                            oldQuantity, item.getQuantity(), oldPrice, item.getPrice()});
+    }
+
+    // Changes an item's quantity and keeps the quantity index and totals in sync
+    void setItemQuantity(int position, int newQuantity) {
+        Item &item = items[position];
+        int oldQuantity = item.getQuantity();
+        quantityIndex.erase(item);
+        totals.apply(item, -1);
+        categoryTotals[item.getCategory()].apply(item, -1);
+
+        item.setQuantity(newQuantity);
+
+        quantityIndex.insert(item);
+        totals.apply(item, 1);
+        categoryTotals[item.getCategory()].apply(item, 1);
+        publishUpdate(item, oldQuantity, item.getPrice());
+    }
+
+    // Adds delta (negative for a sale) to an item's quantity. Safe to call from many threads at
+    // once as long as no item is being added or removed: the stock itself changes through a
+    // lock-free CAS on the item, so concurrent sales never lose updates. Only the bookkeeping
+    // afterwards (quantity index, totals) takes a short lock.
+    AdjustResult adjustQuantity(const string& id, int delta, bool failIfNegative = true) {
+        int position = findItemIndex(id);
+        if (position == -1) return AdjustResult::NotFound;
+
+        Item &item = items[position];
+        int oldQuantity;
+        if (!item.adjustQuantity(delta, failIfNegative, oldQuantity)) {
+            return (delta > 0 || oldQuantity + (long long) delta < numeric_limits<int32_t>::min())
+                   ? AdjustResult::WouldOverflow : AdjustResult::WouldGoNegative;
+        }
+
+        {
+            lock_guard<mutex> lock(derivedMutex);
+            // Drop the entry this adjustment replaced and index whatever value is current now;
+            // racing adjustments of the same item each remove their own old value the same way
+            quantityIndex.erase(item, oldQuantity);
+            quantityIndex.insert(item, item.loadQuantity());
+            totals.applyQuantityDelta(item, delta);
+            categoryTotals[item.getCategory()].applyQuantityDelta(item, delta);
+        }
+
+        recordChange({ChangeEvent::Updated, string(item.getId()), string(item.getName()), item.getCategory(),
+                            oldQuantity, oldQuantity + delta, item.getPrice(), item.getPrice()});
+        return AdjustResult::Applied;
+    }
+
+    // Applies a list of quantity/price changes all-or-nothing. Every change is validated before
+    // anything is written; on failure error describes the first bad line and the inventory is
+    // untouched. Changes are then grouped by storage position (later lines for the same item
+    // win) and applied in one forward pass, so each item's index entries and totals are
+    // updated once no matter how many lines mention it.
+    bool applyBatch(const vector<ItemChange>& changes, string& error) {
+        vector<pair<int, size_t>> byPosition;  // (position in items[], index into changes)
+
+        for (size_t c = 0; c < changes.size(); c++) {
+            const ItemChange &change = changes[c];
+            int position = findItemIndex(change.id);
+
+            if (position == -1) {
+                error = "Item " + change.id + " not found";
+                return false;
+            }
+            // Callers other than the menu may hand in anything, so bound values here as well
+            if (change.hasQuantity && change.quantity <= 0) {
+                error = "Item " + change.id + " needs a positive quantity";
+                return false;
+            }
+            if (change.hasPrice && !(change.price > 0 && validPrice(change.price))) {
+                error = "Item " + change.id + " needs a price above 0 and at most " + to_string((long long) MAX_PRICE);
+                return false;
+            }
+            byPosition.push_back({position, c});
+        }
+
+        sort(byPosition.begin(), byPosition.end());
+
+        for (size_t g = 0; g < byPosition.size();) {
+            int position = byPosition[g].first;
+
+            // Fold every change for this item into its final quantity and price
+            Item &item = items[position];
+            int newQuantity = item.getQuantity();
+            double newPrice = item.getPrice();
+            for (; g < byPosition.size() && byPosition[g].first == position; g++) {
+                const ItemChange &change = changes[byPosition[g].second];
+                if (change.hasQuantity) newQuantity = change.quantity;
+                if (change.hasPrice) newPrice = change.price;
+            }
+
+            if (newQuantity == item.getQuantity() && toCents(newPrice) == item.getPriceCents()) continue;
+
+            int oldQuantity = item.getQuantity();
+            double oldPrice = item.getPrice();
+            quantityIndex.erase(item);
+            priceIndex.erase(item);
+            totals.apply(item, -1);
+            categoryTotals[item.getCategory()].apply(item, -1);
+
+            item.setQuantity(newQuantity);
+            item.setPrice(newPrice);
+
+            quantityIndex.insert(item);
+            priceIndex.insert(item);
+            totals.apply(item, 1);
+            categoryTotals[item.getCategory()].apply(item, 1);
+            publishUpdate(item, oldQuantity, oldPrice);
+        }
+        return true;
+    }
+
+    // Changes an item's price and keeps the price index and totals in sync
+    void setItemPrice(int position, double newPrice) {
+        Item &item = items[position];
+        double oldPrice = item.getPrice();
+        priceIndex.erase(item);
+        totals.apply(item, -1);
+        categoryTotals[item.getCategory()].apply(item, -1);
+
+        item.setPrice(newPrice);
+
+        priceIndex.insert(item);
+        totals.apply(item, 1);
+        categoryTotals[item.getCategory()].apply(item, 1);
+        publishUpdate(item, item.getQuantity(), oldPrice);
+    }
+
+    // Returns the positions of the k first items in the given order (optionally within one category),
+    // by partial selection instead of sorting everything: O(n + k log k) per scanned range
+    template<typename Compare>
+    vector<int> selectTopK(Compare before, size_t k,
+                           const string& category = "", int first = 0, int last = -1) const {
+        if (last == -1) last = itemCount;
+        int categoryId = category.empty() ? -1 : categories.find(category);
+
+        vector<int> positions;
+        for (int i = first; i < last; i++) {
+            if (categoryId == -1 || items[i].getCategoryId() == categoryId) {
+                positions.push_back(i);
+            }
+        }
+
+        auto byOrder = [&](int a, int b) { return before(items[a], items[b]); };
+        if (positions.size() > k) {
+            nth_element(positions.begin(), positions.begin() + k, positions.end(), byOrder);
+            positions.resize(k);
+        }
+        sort(positions.begin(), positions.end(), byOrder);
+        return positions;
+    }
+
+    // Parallel top-k: each thread selects k candidates from its own slice, then the candidates are
+    // reduced once more. Small inventories stay on the sequential path.
+    template<typename Compare>
+    vector<int> parallelSelectTopK(Compare before, size_t k,
+                                   const string& category = "") const {
+        const int PARALLEL_CUTOFF = 10000;  // Below this, thread start-up costs more than it saves
+        int threadCount = (int) max(1u, thread::hardware_concurrency());
+
+        if (itemCount < PARALLEL_CUTOFF || threadCount == 1) {
+            return selectTopK(before, k, category);
+        }
+
+        vector<vector<int>> partials(threadCount);
+        vector<thread> workers;
+        int sliceSize = (itemCount + threadCount - 1) / threadCount;
+
+        for (int t = 0; t < threadCount; t++) {
+            int first = t * sliceSize;
+            int last = min(itemCount, first + sliceSize);
+            workers.emplace_back([&, t, first, last]() {
+                partials[t] = selectTopK(before, k, category, first, last);
+            });
+        }
+        for (auto &worker : workers) worker.join();
+
+        vector<int> candidates;
+        for (auto &partial : partials) {
+            candidates.insert(candidates.end(), partial.begin(), partial.end());
+        }
+
+        auto byOrder = [&](int a, int b) { return before(items[a], items[b]); };
+        if (candidates.size() > k) {
+            nth_element(candidates.begin(), candidates.begin() + k, candidates.end(), byOrder);
+            candidates.resize(k);
+        }
+        sort(candidates.begin(), candidates.end(), byOrder);
+        return candidates;
+    }
+
+    // Stable sort of items[] by the given order. Large inventories are cut into one run per
+    // thread, each run is sorted concurrently, then neighbouring runs are merged pairwise
+    // (also concurrently) until one run remains. Callers must rebuild the ID index afterwards.
+    // threadCount 0 uses one thread per hardware thread.
+    template<typename Compare>
+    void parallelSort(Compare before, int threadCount = 0) {
+        const int PARALLEL_CUTOFF = 10000;  // Below this, a single-threaded sort is faster
+        if (threadCount <= 0) threadCount = (int) max(1u, thread::hardware_concurrency());
+
+        if (itemCount < PARALLEL_CUTOFF || threadCount == 1) {
+            stable_sort(items.data(), items.data() + itemCount, before);
+            return;
+        }
+
+        // Run boundaries: run r covers [bounds[r], bounds[r + 1])
+        vector<int> bounds;
+        int runSize = (itemCount + threadCount - 1) / threadCount;
+        for (int start = 0; start < itemCount; start += runSize) bounds.push_back(start);
+        bounds.push_back(itemCount);
+
+        vector<thread> workers;
+        for (size_t r = 0; r + 1 < bounds.size(); r++) {
+            workers.emplace_back([&, r]() {
+                stable_sort(items.data() + bounds[r], items.data() + bounds[r + 1], before);
+            });
+        }
+        for (auto &worker : workers) worker.join();
+
+        // Merge neighbouring runs until a single sorted run is left
+        while (bounds.size() > 2) {
+            vector<int> merged;
+            workers.clear();
+
+            for (size_t r = 0; r + 1 < bounds.size(); r += 2) {
+                merged.push_back(bounds[r]);
+                if (r + 2 < bounds.size()) {
+                    workers.emplace_back([&, r]() {
+                        inplace_merge(items.data() + bounds[r], items.data() + bounds[r + 1], items.data() + bounds[r + 2], before);
+                    });
+                }
+            }
+            merged.push_back(itemCount);
+            for (auto &worker : workers) worker.join();
+
+            bounds = merged;
+        }
+    }
+
+    // Re-maps every ID to its position after items[] has been reordered in place
+    void rebuildIdIndex() {
+        idIndex.clear();
+        for (int i = 0; i < itemCount; i++) {
+            idIndex[string(items[i].getId())] = i;
+        }
+    }
+
+    // Method to validate numeric input (prices must also pass validPrice)
+    template<typename T>
+    void validateInput(T& value) {
+        while (!(input >> value) || value <= 0 || (is_floating_point_v<T> && !validPrice(value))) {
+            cout << "Invalid input. Please enter a positive value: ";
+            input.clear();
+            input.ignoreLine();
+        }
+    }
+
+    // Method to validate a numeric bound, which unlike other input may be 0
+    template<typename T>
+    void validateBound(T& value) {
+        while (!(input >> value) || value < 0 || (is_floating_point_v<T> && !validPrice(value))) {
+            cout << "Invalid input. Please enter 0 or a positive value: ";
+            input.clear();
+            input.ignoreLine();
+        }
+    }
+
+    // Method to read the two bounds of a range, asking again for a maximum below the minimum
+    template<typename T>
+    void validateRange(const string& label, T& minimum, T& maximum) {
+        cout << "Minimum " << label << ": ";
+        validateBound(minimum);
+        while (true) {
+            cout << "Maximum " << label << ": ";
+            validateBound(maximum);
+            if (maximum >= minimum) return;
+            cout << "The maximum cannot be below the minimum (" << minimum << ").\n";
+        }
+    }
+
+    // Asks for a category until a registered one (or "All" if allowed) is entered. The canonical
+    // name is stored in category ("" for All). Returns false if the user chose to go back.
+    bool promptCategory(string& category, bool allowAll) {
+        while (true) {
+            cout << "Input Category (" << categories.listNames() << (allowAll ? ", All" : "") << "): ";
+            input >> category;
+
+            // Check for back option
+            if (category == "0") {
+                return false;
+            }
+
+            int categoryId = categories.find(category);
+            if (categoryId != -1) {
+                category = categories.name(categoryId);
+                return true;
+            }
+
+            for (auto &c : category) c = tolower(c);
+            if (allowAll && category == "all") {
+                category = "";  // An empty category means no restriction
+                return true;
+            }
+
+            cout << "Invalid category! Please enter a valid category.\n";
+        }
+    }
+
+    // Method to add a new item to the inventory
+    void addItem() override {
+        string id, name, category;
+        int quantity;
+        double price;
+        char choice;
+
+        cout << "[Back - 0]\n";
+        if (!promptCategory(category, false)) {
+            return; // Go back to main menu
+        }
+
+        while (true) {
+            cout << "Input ID: ";
+            input >> id;
+
+            // Check if the user entered "0" as the item ID
+            if (id == "0") {
+                cout << "ID cannot be 0. Please enter a valid ID.\n";
+                continue; // Prompt for the ID again
+            }
+
+            // IDs are stored inline in the item record
+            if (id.size() > Item::MAX_ID_LENGTH) {
+                cout << "ID cannot be longer than " << Item::MAX_ID_LENGTH << " characters.\n";
+                continue;
+            }
+
+            // Check for existing ID
+            if (findItemIndex(id) != -1) {
+                cout << "Item already in inventory. Please enter a different ID.\n";
+            } else {
+                break; // ID is unique and valid, exit the loop
+            }
+        }
+
+        // Names are stored inline in the item record as well
+        while (true) {
+            cout << "Input Name: ";
+            input >> name;
+
+            if (name.size() > Item::MAX_NAME_LENGTH) {
+                cout << "Name cannot be longer than " << Item::MAX_NAME_LENGTH << " characters.\n";
+            } else {
+                break;
+            }
+        }
+
+        // Validate quantity and price input
+        cout << "Quantity: ";
+        validateInput(quantity);
+
+        cout << "Price: ";
+        validateInput(price);
+
+        // Check if we can add more items
+        if (insertItem(Item(id, name, quantity, price, category))) {  // Add item to the inventory
+            cout << "Item added successfully!\n";
+        } else {
+            cout << "Cannot add more items. Inventory is full.\n";
+        }
+
+        // Ensure only valid inputs for 'add another item'
+        do {
+            cout << "Add another item? [Y/N]: ";
+            input >> choice;
+            choice = toupper(choice);
+            if (choice == 'Y') {
+                addItem();
+                break;
+            } else if (choice == 'N') {
+                break;
+            } else {
+                cout << "Invalid input. Please enter 'Y' or 'N'.\n";
+            }
+        } while (true);
+    }
+
+    // Method to update an item's quantity or price
+    void updateItem() override {
+        if (itemCount == 0) {
+            cout << "Please add items first!\n";
+            return;
+        }
+
+        string id, updateChoice;
+        int newQuantity;
+        double newPrice;
+        char choice;
+        bool itemFound;
+
+        do {
+            itemFound = false; // Reset for each loop
+
+            cout << "[Back - 0]\n";
+            cout << "Input ID: ";
+            input >> id;
+
+            if (id == "0") return; // Exit if user inputs "0"
+
+            // Searching for the item with the given ID
+            int i = findItemIndex(id);
+            if (i != -1) {
+                itemFound = true;
+                do {
+                    cout << "What to update? [Qty/Price]: ";
+                    input >> updateChoice;
+                    // Convert to lowercase for case-insensitive comparison
+                    for (auto &c : updateChoice) c = tolower(c);
+
+                    if (updateChoice == "qty") {
+                        cout << "New Quantity: ";
+                        validateInput(newQuantity);
+
+                        if (newQuantity == items[i].getQuantity()) {
+                            cout << "The Quantity of " << items[i].getName() << " is already " << newQuantity << endl;
+                        } else {
+                            cout << items[i].getName() << " Quantity updated from " << items[i].getQuantity();
+                            setItemQuantity(i, newQuantity);
+                            cout << " --> " << items[i].getQuantity() << endl;
+                        }
+                    } else if (updateChoice == "price") {
+                        cout << "New Price: ";
+                        validateInput(newPrice);
+
+                        // Compare in whole cents, the unit prices are stored in
+                        if (toCents(newPrice) == items[i].getPriceCents()) {
+                            cout << "The Price of " << items[i].getName() << " is already " << newPrice << endl;
+                        } else {
+                            cout << items[i].getName() << " Price updated from " << items[i].getPrice();
+                            setItemPrice(i, newPrice);
+                            cout << " --> " << items[i].getPrice() << endl;
+                        }
+                    } else {
+                        cout << "Invalid choice! Please enter 'Qty' or 'Price'.\n";
+                    }
+                } while (updateChoice != "qty" && updateChoice != "price");
+            }
+
+            if (!itemFound) {
+                cout << "Item not found!\n";
+            }
+
+            // Ask if they want to update another item
+            cout << "Update another item? [Y/N]: ";
+            input >> choice;
+
+        } while (tolower(choice) == 'y');
+    }
+
+    // Method to remove an item from the inventory
+    void removeItem() override {
+        if (itemCount == 0) {
+            cout << "Please add items first!\n";
+            return;
+        }
+
+        string id;
+        char choice;
+        bool itemFound = false;
+
+        do {
+            cout << "[Back - 0]\n";
+            cout << "Input ID: ";
+            input >> id;
+
+            if (id == "0") return;  // Exit to main menu if "0" is entered
+
+            // Searching for the item with the given ID
+            int i = findItemIndex(id);
+            if (i != -1) {
+                itemFound = true;
+                cout << items[i].getName() << " has been removed from the inventory.\n";
+                eraseItemAt(i);  // Shift the remaining items and decrease the item count
+            }
+
+            if (!itemFound) {
+                cout << "Item not found!\n";
+            }
+
+            // Check if the inventory is now empty
+            if (itemCount == 0) {
+                cout << "Inventory is empty. Returning to main menu...\n";
+                return; // Exit to main menu if inventory is empty
+            }
+
+            // Ask if the user wants to remove another item
+            cout << "Remove another item? [Y/N]: ";
+            input >> choice;
+
+        } while (tolower(choice) == 'y');
+    }
+
+    // Method to display items by category
+    void displayItemsByCategory() override {
+        if (itemCount == 0) {
+            cout << "Please add items first!\n";
+            return;
+        }
+
+        string categoryChoice;
+        bool categoryFound = false;
+
+        cout << "[Back - 0]\n";
+        if (!promptCategory(categoryChoice, false)) {
+            return; // Return to main menu if input is '0'
+        }
+
+        // Display items in the chosen category
+        cout << "ID        ITEM           QTY     PRICE   \n";
+        cout << "-----------------------------------------\n";
+        bool itemsExist = false;
+        int categoryId = categories.find(categoryChoice);
+        for (int i = 0; i < itemCount; i++) {
+            if (items[i].getCategoryId() == categoryId) {
+                categoryFound = true;
+                itemsExist = true;
+                cout << left << setw(10) << items[i].getId()
+                     << setw(15) << items[i].getName()
+                     << setw(8) << items[i].getQuantity()
+                     << setw(8) << items[i].getPrice() << endl;
+            }
+        }
+
+        if (!itemsExist) {
+            cout << "No items available in this category.\n";
+        }
+    }
+
+    // Method to display all items in a formatted table
+    void displayAllItems() override {
+        if (itemCount == 0) {
+            cout << "Please add items first!\n";
+            return;
+        }
+
+        cout << "ID        ITEM           QTY     PRICE   CATEGORY\n";
+        cout << "-------------------------------------------------\n";
+        for (int i = 0; i < itemCount; i++) {
+            cout << left << setw(10) << items[i].getId()
+                 << setw(15) << items[i].getName()
+                 << setw(8) << items[i].getQuantity()
+                 << setw(8) << items[i].getPrice()
+                 << setw(10) << items[i].getCategory() << endl;
+        }
+    }
+
+    // Method to search for an item by ID
+    void searchItem() override {
+        if (itemCount == 0) {
+            cout << "Please add items first!\n";
+            return;
+        }
+
+        string id;
+        bool itemFound;
+        char choice;
+
+        do {
+            itemFound = false; // Reset itemFound for each search attempt
+
+            cout << "[Back - 0]\n";
+            cout << "Input ID: ";
+            input >> id;
+
+            if (id == "0") return;  // Exit to main menu if "0" is entered
+
+            // Searching for the item with the given ID
+            int i = findItemIndex(id);
+            if (i != -1) {
+                itemFound = true;
+
+                // Display item in table format
+                cout << "Item found:\n";
+                cout << "---------------------------------------------------\n";
+                cout << left << setw(10) << "ID"
+                     << left << setw(20) << "Name"
+                     << left << setw(10) << "Quantity"
+                     << left << setw(10) << "Price" << endl;
+                cout << "---------------------------------------------------\n";
+                cout << left << setw(10) << items[i].getId()
+                     << left << setw(20) << items[i].getName()
+                     << left << setw(10) << items[i].getQuantity()
+                     << left << setw(10) << items[i].getPrice() << endl;
+                cout << "---------------------------------------------------\n";
+            }
+
+            if (!itemFound) {
+                cout << "Item not found!\n";
+            }
+
+            // Ask the user if they want to search again and validate input
+            do {
+                cout << "Search item again? [Y/N]: ";
+                input >> choice;
+                choice = tolower(choice); // Convert input to lowercase for easier validation
+            } while (choice != 'y' && choice != 'n'); // Repeat until 'y' or 'n' is entered
+
+        } while (choice == 'y'); // Continue searching if 'Y' or 'y' is entered
+    }
+
+    // Method to sort items by name, price or quantity
+    void sortItems() override {
+        if (itemCount == 0) {
+            cout << "Please add items first!\n";
+            return;
+        }
+
+        string sortChoice;
+        char orderChoice;
+
+        // Display back option
+        cout << "[Back - 0]\n";
+
+        // Ask the user for sorting criteria (Name, Price, Quantity)
+        while (true) {
+            cout << "Sort by [Name/Price/Quantity]: ";
+            input >> sortChoice;
+            if (sortChoice == "0") return; // Return to main menu if input is '0'
+
+            for (auto &c : sortChoice) c = tolower(c);  // Convert to lowercase for case-insensitive comparison
+
+            if (sortChoice == "name" || sortChoice == "price" || sortChoice == "quantity") {
+                break; // Valid input, exit loop
+            } else {
+                cout << "Invalid choice! Please enter 'Name', 'Price', or 'Quantity'.\n";
+            }
+        }
+
+        // Ask the user for sorting order (Ascending or Descending)
+        while (true) {
+            cout << "Sort in [A-Ascending/D-Descending]: ";
+            input >> orderChoice;
+            if (orderChoice == '0') return; // Return to main menu if input is '0'
+
+            orderChoice = tolower(orderChoice);  // Convert input to lowercase for easier validation
+            if (orderChoice == 'a' || orderChoice == 'd') {
+                break; // Valid input, exit loop
+            } else {
+                cout << "Invalid choice! Please enter 'A' for Ascending or 'D' for Descending.\n";
+            }
+        }
+
+        // Stable merge sort, split across threads for large inventories
+        if constexpr (PersistentItemStorage<Storage>) items.beginMove();
+        withItemOrder(sortChoice, orderChoice == 'a', [&](auto order) {
+            parallelSort(order);
+        });
+        if constexpr (PersistentItemStorage<Storage>) {
+            items.endMove();
+            items.changed();
+        }
+        if (persistedInPlace()) {
+            // Every record of the item file was rewritten, so the next save flushes them all
+            lock_guard<mutex> lock(derivedMutex);
+            for (int i = 0; i < itemCount; i++) dirtyIds.insert(string(items[i].getId()));
+        }
+        rebuildIdIndex();  // Positions changed, keep the ID index in sync
+
+        // Display sorted items in table format
+        cout << "Items sorted by " << sortChoice << " in "
+             << ((orderChoice == 'a') ? "Ascending" : "Descending") << " order:\n";
+        cout << "---------------------------------------------------\n";
+        cout << left << setw(10) << "ID"
+             << left << setw(20) << "Name"
+             << left << setw(10) << "Quantity"
+             << left << setw(10) << "Price" << endl;
+        cout << "---------------------------------------------------\n";
+        for (int i = 0; i < itemCount; i++) {
+            cout << left << setw(10) << items[i].getId()
+                 << left << setw(20) << items[i].getName()
+                 << left << setw(10) << items[i].getQuantity()
+                 << left << setw(10) << items[i].getPrice() << endl;
+        }
+        cout << "---------------------------------------------------\n";
+    }
+
+    // Method to display items that are low in stock (quantity <= LOW_STOCK_THRESHOLD)
+    void displayLowStockItems() override {
+        if (itemCount == 0) {
+            cout << "Please add items first!\n";
+            return;
+        }
+
+        vector<int> lowStock = selectPlanned(
+                ItemFilter::where(ItemFilter::Quantity, ItemFilter::LessEqual, LOW_STOCK_THRESHOLD));
+
+        cout << "Low stock items (Quantity <= " << LOW_STOCK_THRESHOLD << "):\n";
+        cout << "ID        ITEM           QTY     PRICE   CATEGORY\n";
+        cout << "-------------------------------------------------\n";
+
+        for (int i : lowStock) displayRow(i);
+
+        if (lowStock.empty()) {
+            cout << "No low stock items.\n";
+        }
+    }
+
+    // Rebuilds the planner's histograms from the ordered indexes once about a tenth of the
+    // inventory has changed since they were built
+    void refreshStatistics() {
+        if (statisticsBuiltAt != -1 && changeCount - statisticsBuiltAt < max(8, itemCount / 10)) return;
+
+        vector<long long> values;
+        for (double price : priceIndex.keys()) values.push_back(toCents(price));
+        priceHistogram.build(values);
+
+        values.clear();
+        for (int quantity : quantityIndex.keys()) values.push_back(quantity);
+        quantityHistogram.build(values);
+
+        statisticsBuiltAt = changeCount;
+    }
+
+    // Estimated fraction of the items satisfying one condition: category counts come from the
+    // running totals, prices and quantities from the histograms
+    double conditionSelectivity(const ItemFilter::Condition& condition) const {
+        if (itemCount == 0) return 0;
+
+        switch (condition.field) {
+            case ItemFilter::Category: {
+                auto it = categoryTotals.find(categories.name(condition.number));
+                double fraction = (it == categoryTotals.end()) ? 0 : (double) it->second.itemCount / itemCount;
+                return (condition.op == ItemFilter::Equal) ? fraction : 1 - fraction;
+            }
+            case ItemFilter::Quantity:
+                return quantityHistogram.selectivity(condition.op, condition.number);
+            case ItemFilter::Price:
+                return priceHistogram.selectivity(condition.op, condition.number);
+            default:
+                // IDs are unique; names are close to it. Other text comparisons get the usual guess.
+                if (condition.op == ItemFilter::Equal) return 1.0 / itemCount;
+                if (condition.op == ItemFilter::NotEqual) return 1 - 1.0 / itemCount;
+                return 1.0 / 3;
+        }
+    }
+
+    // Lists the access paths that can answer an AND-clause, with their estimated rows and cost
+    vector<AccessPath> accessPaths(const vector<ItemFilter::Condition>& clause) const {
+        double n = itemCount;
+        vector<AccessPath> paths = {{AccessPath::FullScan, {}, n, n}};
+
+        int categoryCondition = -1;
+        vector<int> rangeConditions;
+        for (int c = 0; c < (int) clause.size(); c++) {
+            const ItemFilter::Condition &condition = clause[c];
+
+            if (condition.field == ItemFilter::Id && condition.op == ItemFilter::Equal) {
+                paths.push_back({AccessPath::IdLookup, {c}, 1, 1});
+            } else if (condition.field == ItemFilter::Category && condition.op == ItemFilter::Equal) {
+                double rows = n * conditionSelectivity(condition);
+                paths.push_back({AccessPath::CategoryIndex, {c}, rows, INDEX_ENTRY_COST * rows});
+                if (categoryCondition == -1) categoryCondition = c;
+            } else if ((condition.field == ItemFilter::Quantity || condition.field == ItemFilter::Price) &&
+                       condition.op != ItemFilter::NotEqual) {
+                rangeConditions.push_back(c);
+            }
+        }
+
+        // Range scans read the category's own partition of the index when there is one
+        double scope = (categoryCondition == -1) ? n : n * conditionSelectivity(clause[categoryCondition]);
+        auto withCategory = [&](vector<int> driving) {
+            if (categoryCondition != -1) driving.push_back(categoryCondition);
+            return driving;
+        };
+
+        for (int c : rangeConditions) {
+            double rows = scope * conditionSelectivity(clause[c]);
+            paths.push_back({AccessPath::IndexRange, withCategory({c}), rows,
+                             log2(n + 1) + INDEX_ENTRY_COST * rows});
+        }
+
+        // Two ranges on different columns: mark both ranges in bitmaps and AND them
+        for (size_t a = 0; a < rangeConditions.size(); a++) {
+            for (size_t b = a + 1; b < rangeConditions.size(); b++) {
+                const ItemFilter::Condition &first = clause[rangeConditions[a]];
+                const ItemFilter::Condition &second = clause[rangeConditions[b]];
+                if (first.field == second.field) continue;
+
+                double firstRows = scope * conditionSelectivity(first);
+                double secondRows = scope * conditionSelectivity(second);
+                paths.push_back({AccessPath::BitmapIntersection, withCategory({rangeConditions[a], rangeConditions[b]}),
+                                 scope * conditionSelectivity(first) * conditionSelectivity(second),
+                                 2 * log2(n + 1) + INDEX_ENTRY_COST * (firstRows + secondRows) + n / 64});
+            }
+        }
+        return paths;
+    }
+
+    // Positions (in storage order) of the items an index range covers, optionally in one category
+    vector<int> positionsInRange(const ItemFilter::Condition& condition, const string& category) const {
+        long long low = numeric_limits<long long>::min() / 2, high = numeric_limits<long long>::max() / 2;
+        switch (condition.op) {
+            case ItemFilter::Equal: low = high = condition.number; break;
+            case ItemFilter::Less: high = condition.number - 1; break;
+            case ItemFilter::LessEqual: high = condition.number; break;
+            case ItemFilter::Greater: low = condition.number + 1; break;
+            default: low = condition.number; break;
+        }
+
+        vector<string> ids;
+        if (condition.field == ItemFilter::Quantity) {
+            low = max<long long>(low, numeric_limits<int>::min());
+            high = min<long long>(high, numeric_limits<int>::max());
+            if (low <= high) ids = quantityIndex.range(low, high, category);
+        } else {
+            ids = priceIndex.range(low / 100.0, high / 100.0, category);
+        }
+
+        vector<int> positions;
+        for (auto &id : ids) positions.push_back(findItemIndex(id));
+        sort(positions.begin(), positions.end());
+        return positions;
+    }
+
+    // Produces the rows of an access path, in storage order
+    vector<int> runAccessPath(const AccessPath& path, const vector<ItemFilter::Condition>& clause) const {
+        vector<int> positions;
+        string category;
+        for (int c : path.driving) {
+            if (clause[c].field == ItemFilter::Category) category = categories.name(clause[c].number);
+        }
+
+        switch (path.kind) {
+            case AccessPath::FullScan:
+                positions.resize(itemCount);
+                for (int i = 0; i < itemCount; i++) positions[i] = i;
+                break;
+            case AccessPath::IdLookup: {
+                int position = findItemIndex(clause[path.driving[0]].text);
+                if (position != -1) positions.push_back(position);
+                break;
+            }
+            case AccessPath::CategoryIndex:
+                for (auto &id : quantityIndex.range(numeric_limits<int>::min(), numeric_limits<int>::max(), category)) {
+                    positions.push_back(findItemIndex(id));
+                }
+                sort(positions.begin(), positions.end());
+                break;
+            case AccessPath::IndexRange:
+                positions = positionsInRange(clause[path.driving[0]], category);
+                break;
+            case AccessPath::BitmapIntersection: {
+                vector<uint64_t> first((itemCount + 63) / 64), second((itemCount + 63) / 64);
+                for (int p : positionsInRange(clause[path.driving[0]], category)) first[p / 64] |= 1ULL << (p % 64);
+                for (int p : positionsInRange(clause[path.driving[1]], category)) second[p / 64] |= 1ULL << (p % 64);
+
+                for (size_t w = 0; w < first.size(); w++) {
+                    for (uint64_t bits = first[w] & second[w]; bits != 0; bits &= bits - 1) {
+                        positions.push_back(w * 64 + __builtin_ctzll(bits));
+                    }
+                }
+                break;
+            }
+        }
+        return positions;
+    }
+
+    // Names an access path for explain output
+    static string describeAccessPath(const AccessPath& path, const vector<ItemFilter::Condition>& clause) {
+        static const char* fieldNames[] = {"id", "name", "category", "quantity", "price"};
+        string category;
+        for (int c : path.driving) {
+            if (clause[c].field == ItemFilter::Category) category = " in category " + categories.name(clause[c].number);
+        }
+
+        switch (path.kind) {
+            case AccessPath::FullScan:
+                return "full scan";
+            case AccessPath::IdLookup:
+                return "ID lookup";
+            case AccessPath::CategoryIndex:
+                return "category index";
+            case AccessPath::IndexRange:
+                return string(fieldNames[clause[path.driving[0]].field]) + " index range" + category;
+            default:
+                return string("bitmap of ") + fieldNames[clause[path.driving[0]].field] + " and " +
+                       fieldNames[clause[path.driving[1]].field] + " index ranges" + category;
+        }
+    }
+
+    // Returns the positions of the items matching a filter, in storage order. Each AND-clause
+    // runs through its cheapest access path, then the conditions that path did not answer
+    // narrow its rows; explain prints the plans considered and estimated vs actual rows.
+    vector<int> selectPlanned(const ItemFilter& filter, bool explain = false) {
+        refreshStatistics();
+
+        vector<int> result;
+        for (size_t k = 0; k < filter.clauses.size(); k++) {
+            const vector<ItemFilter::Condition> &clause = filter.clauses[k];
+            vector<AccessPath> paths = accessPaths(clause);
+            const AccessPath &chosen = *min_element(paths.begin(), paths.end(),
+                    [](const AccessPath& a, const AccessPath& b) { return a.cost < b.cost; });
+
+            vector<int> positions = runAccessPath(chosen, clause);
+            size_t fetched = positions.size();
+
+            string residual;
+            double estimated = itemCount;
+            for (int c = 0; c < (int) clause.size(); c++) {
+                estimated *= conditionSelectivity(clause[c]);
+                if (std::find(chosen.driving.begin(), chosen.driving.end(), c) != chosen.driving.end()) continue;
+
+                ItemFilter::narrow(items.data(), positions, clause[c]);
+                residual += (residual.empty() ? "" : " and ") + ItemFilter::describe(clause[c]);
+            }
+
+            if (explain) {
+                string conditions;
+                for (auto &condition : clause) {
+                    conditions += (conditions.empty() ? "" : " and ") + ItemFilter::describe(condition);
+                }
+                cout << "Clause " << k + 1 << ": " << conditions << "\n";
+                cout << "  Plans: ";
+                for (size_t p = 0; p < paths.size(); p++) {
+                    cout << (p == 0 ? "" : ", ") << describeAccessPath(paths[p], clause)
+                         << " (cost " << fixed << setprecision(1) << paths[p].cost << ")";
+                }
+                cout << "\n  Chosen: " << describeAccessPath(chosen, clause);
+                if (!residual.empty()) cout << ", then check " << residual;
+                cout << "\n  Rows: estimated " << estimated << ", actual " << positions.size()
+                     << " (" << fetched << " read by the access path)\n";
+                cout << defaultfloat << setprecision(6);
+            }
+
+            vector<int> merged;
+            set_union(result.begin(), result.end(), positions.begin(), positions.end(), back_inserter(merged));
+            result.swap(merged);
+        }
+        return result;
+    }
+
+    // Method to export all items, or those matching a filter, to a CSV or JSON Lines file
+    void exportItems() override {
+        string formatChoice, path, text, error;
+        ItemFilter filter;
+        bool allItems;
+        int shards;
+
+        cout << "[Back - 0]\n";
+        while (true) {
+            cout << "Format [CSV/JSON]: ";
+            input >> formatChoice;
+            if (formatChoice == "0") return; // Return to main menu if input is '0'
+
+            for (auto &c : formatChoice) c = tolower(c);
+            if (formatChoice == "csv" || formatChoice == "json") break;
+            cout << "Invalid choice! Please enter 'CSV' or 'JSON'.\n";
+        }
+
+        cout << "File name: ";
+        input >> path;
+        if (path == "0") return;
+
+        input.ignoreLine();  // Rest of the file name line
+        while (true) {
+            cout << "Filter (empty for all items, e.g. category = electronics): ";
+            if (!input.getline(text) || text == "0") return;
+
+            allItems = text.find_first_not_of(" \t") == string::npos;
+            if (allItems || ItemFilter::parse(text, filter, error)) break;
+            cout << error << ".\n";
+        }
+
+        cout << "Number of files (1 for a single file): ";
+        while (true) {
+            validateInput(shards);
+            if (shards <= maxExportShards()) break;
+            cout << "At most " << maxExportShards() << " files. Number of files: ";
+        }
+
+        vector<ExportRow> rows;
+        if (allItems) {
+            for (int i = 0; i < itemCount; i++) rows.push_back({&items[i], ""});
+        } else {
+            for (int i : selectPlanned(filter)) rows.push_back({&items[i], ""});
+        }
+        ItemExporter::Format format = (formatChoice == "csv") ? ItemExporter::Csv : ItemExporter::JsonLines;
+
+        bool written;
+        if (shards > 1) {
+            written = exportToShards(rows, format, false, path, shards);
+        } else {
+            int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            written = fd != -1 && exportOrdered(rows, format, false, fd);
+            if (fd != -1) ::close(fd);
+        }
+
+        if (!written) {
+            cout << "Writing " << path << " failed.\n";
+        } else if (shards > 1) {
+            cout << rows.size() << " item(s) exported to " << shardPath(path, 1) << " ... "
+                 << shardPath(path, shards) << ".\n";
+        } else {
+            cout << rows.size() << " item(s) exported to " << path << ".\n";
+        }
+    }
+
+    // Method to add items in bulk from a CSV file in the export format (id, name, category,
+    // quantity, price, optionally after a warehouse column). New IDs are the common case, and
+    // the ID filter answers most of their duplicate checks without touching the ID index.
+    void importItems() override {
+        string path;
+
+        cout << "[Back - 0]\n";
+        cout << "CSV file: ";
+        input >> path;
+        if (path == "0") return;
+
+        MappedFile file;
+        if (!file.open(path)) {
+            cout << "Cannot open " << path << ".\n";
+            return;
+        }
+
+        string_view data = file.contents();
+        vector<string> fields;
+        size_t pos = 0, idColumn = 0;
+        int imported = 0, duplicates = 0, invalid = 0, notLoaded = 0;
+        long long answeredBefore = idFilter.definitelyNew;
+
+        for (bool first = true; readCsvRecord(data, pos, fields); first = false) {
+            if (fields.size() == 1 && fields[0].empty()) continue;  // Blank line
+
+            // The header, if there is one, tells whether a warehouse column comes first
+            if (first && (fields[0] == "id" || fields[0] == "warehouse")) {
+                idColumn = (fields[0] == "warehouse") ? 1 : 0;
+                continue;
+            }
+            if (first && fields.size() == 6) idColumn = 1;
+
+            int quantity;
+            double price;
+            if (fields.size() < idColumn + 5) {
+                invalid++;
+                continue;
+            }
+            const string &id = fields[idColumn], &name = fields[idColumn + 1], &category = fields[idColumn + 2];
+
+            if (id.empty() || id.size() > Item::MAX_ID_LENGTH || name.size() > Item::MAX_NAME_LENGTH ||
+                categories.find(category) == -1 ||
+                !parseQuantity(fields[idColumn + 3], quantity) || !parsePrice(fields[idColumn + 4], price)) {
+                invalid++;
+            } else if (findItemIndex(id) != -1) {
+                duplicates++;
+            } else if (insertItem(Item(id, name, quantity, price, category))) {
+                imported++;
+            } else {
+                notLoaded++;
+            }
+        }
+
+        cout << imported << " item(s) imported, " << duplicates << " duplicate ID(s) skipped, "
+             << invalid << " invalid row(s).\n";
+        if (notLoaded > 0) {
+            cout << notLoaded << " item(s) could not be added. Inventory is full.\n";
+        }
+        cout << "The ID filter answered " << idFilter.definitelyNew - answeredBefore << " of "
+             << imported + duplicates + notLoaded << " duplicate checks without the ID index.\n";
+    }
+
+    // Prints the ID filter's size, configuration and hit counts
+    void displayIdFilterStats() const {
+        char line[256];
+        snprintf(line, sizeof(line),
+                 "ID filter: %zu bits (%zu bytes), %d hash(es), sized for %zu IDs at %.2f%% false positives; "
+                 "%zu ID(s) set, estimated rate %.4f%%\n",
+                 idFilter.bitSize(), idFilter.memoryBytes(), idFilter.hashFunctions(), idFilter.expectedIds(),
+                 idFilter.configuredRate() * 100, idFilter.insertedIds(), idFilter.estimatedRate() * 100);
+        cout << line;
+        cout << "ID lookups answered by the filter: " << idFilter.definitelyNew
+             << ", false positives: " << idFilter.falsePositives << endl;
+    }
+
+    // Method to show the ID filter and change its target false-positive rate
+    void configureIdFilter() override {
+        double percent;
+
+        displayIdFilterStats();
+        cout << "[Keep - 0]\n";
+        cout << "Target false-positive rate in %: ";
+        // Written so that NaN fails every comparison and is rejected
+        while (!(input >> percent) ||
+               !(percent == 0 || (percent >= IdFilter::MIN_RATE * 100 && percent <= IdFilter::MAX_RATE * 100))) {
+            cout << "Invalid input. Please enter a rate between " << IdFilter::MIN_RATE * 100 << " and "
+                 << IdFilter::MAX_RATE * 100 << ", or 0 to keep it: ";
+            input.clear();
+            input.ignoreLine();
+        }
+        if (percent == 0) return;  // Keep the current rate
+
+        rebuildIdFilter(percent / 100);
+        displayIdFilterStats();
+    }
+
+    // Method to choose when an item file is flushed to the disk
+    void configureStorageSync() override {
+        if constexpr (PersistentItemStorage<Storage>) {
+            if (!items.isOpen()) {
+                cout << "This inventory has no item file.\n";
+                return;
+            }
+
+            static const char *policyNames[] = {"Kernel", "Save", "Change"};
+            int choice;
+
+            cout << "Items are written in place to " << store->itemFilePath() << ". They are flushed to the disk:\n";
+            cout << "1 - When the kernel writes them back (fastest; survives a crash, not a power loss)\n";
+            cout << "2 - On Save Changes and exit\n";
+            cout << "3 - After every change (slowest)\n";
+            cout << "Current: " << policyNames[(int) items.syncPolicy()] << "\n";
+            cout << "[Keep - 0]\n";
+            cout << "Enter choice: ";
+            while (!(input >> choice) || choice < 0 || choice > 3) {
+                cout << "Invalid input. Please enter a number from 0 to 3: ";
+                input.clear();
+                input.ignoreLine();
+            }
+            if (choice == 0) return;
+
+            items.setSyncPolicy((MappedItemFile::SyncPolicy) (choice - 1));
+            cout << "Sync policy set to " << policyNames[choice - 1] << ".\n";
+            if (!items.sync()) {  // Flush what the old policy may have left behind
+                cout << "Flushing the item file failed; Save Changes will try again.\n";
+            }
+        } else {
+            cout << "Items are kept in memory and saved through checkpoints; there is no item file to sync.\n";
+        }
+    }
+
+    // Method to list the items matching a filter expression
+    void filterItems() override {
+        if (itemCount == 0) {
+            cout << "Please add items first!\n";
+            return;
+        }
+
+        string text, error;
+        ItemFilter filter;
+        bool explain;
+
+        cout << "[Back - 0]\n";
+        input.ignoreLine();  // Rest of the menu choice line
+        while (true) {
+            cout << "Filter (e.g. category = electronics and quantity < 10 and price > 50;\n"
+                    "        start with 'explain' to see the query plan): ";
+            if (!input.getline(text) || text == "0") return;
+
+            // "explain <filter>" also prints how the filter is answered
+            string prefix = text.substr(0, 8);
+            for (auto &c : prefix) c = tolower(c);
+            explain = prefix == "explain ";
+            if (explain) text.erase(0, 8);
+
+            if (ItemFilter::parse(text, filter, error)) break;
+            cout << error << ".\n";
+        }
+
+        vector<int> matches = selectPlanned(filter, explain);
+        if (matches.empty()) {
+            cout << "No items match.\n";
+            return;
+        }
+
+        cout << "ID        ITEM           QTY     PRICE   CATEGORY\n";
+        cout << "-------------------------------------------------\n";
+        for (int i : matches) displayRow(i);
+        cout << matches.size() << " item(s) match.\n";
+    }
+
+    // Method to find items whose name is close to the input (tolerates up to 2 typos)
+    void fuzzySearchByName() override {
+        if (itemCount == 0) {
+            cout << "Please add items first!\n";
+            return;
+        }
+
+        const int MAX_TYPOS = 2;      // Maximum edit distance accepted as a match
+        const size_t MAX_RESULTS = 10;  // Show only the closest matches
+
+        string name;
+        char choice;
+
+        do {
+            cout << "[Back - 0]\n";
+            cout << "Input Name: ";
+            input >> name;
+
+            if (name == "0") return;  // Exit to main menu if "0" is entered
+
+            vector<NameIndex::Match> matches = nameIndex.search(name, MAX_TYPOS, MAX_RESULTS);
+
+            if (matches.empty()) {
+                cout << "No items with a similar name found!\n";
+            } else {
+                cout << "Closest matches:\n";
+                cout << "---------------------------------------------------\n";
+                cout << left << setw(10) << "ID"
+                     << left << setw(20) << "Name"
+                     << left << setw(10) << "Quantity"
+                     << left << setw(10) << "Price"
+                     << left << setw(6) << "Typos" << endl;
+                cout << "---------------------------------------------------\n";
+                for (auto &match : matches) {
+                    int i = findItemIndex(match.id);
+                    cout << left << setw(10) << items[i].getId()
+                         << left << setw(20) << items[i].getName()
+                         << left << setw(10) << items[i].getQuantity()
+                         << left << setw(10) << items[i].getPrice()
+                         << left << setw(6) << match.distance << endl;
+                }
+                cout << "---------------------------------------------------\n";
+            }
+
+            // Ask the user if they want to search again and validate input
+            do {
+                cout << "Search name again? [Y/N]: ";
+                input >> choice;
+                choice = tolower(choice);
+            } while (choice != 'y' && choice != 'n');
+
+        } while (choice == 'y');
+    }
+
+    // Method to list items whose price or quantity falls within a range, in ascending order
+    void rangeQuery() override {
+        if (itemCount == 0) {
+            cout << "Please add items first!\n";
+            return;
+        }
+
+        string field, categoryChoice;
+        vector<string> ids;
+
+        cout << "[Back - 0]\n";
+
+        // Ask the user which field to query
+        while (true) {
+            cout << "Range by [Price/Quantity]: ";
+            input >> field;
+            if (field == "0") return; // Return to main menu if input is '0'
+
+            for (auto &c : field) c = tolower(c);  // Convert to lowercase for case-insensitive comparison
+
+            if (field == "price" || field == "quantity") {
+                break; // Valid input, exit loop
+            } else {
+                cout << "Invalid choice! Please enter 'Price' or 'Quantity'.\n";
+            }
+        }
+
+        // Optionally restrict the query to one category
+        if (!promptCategory(categoryChoice, true)) return; // Return to main menu if input is '0'
+
+        if (field == "price") {
+            double minPrice, maxPrice;
+            validateRange("Price", minPrice, maxPrice);
+            ids = priceIndex.range(minPrice, maxPrice, categoryChoice);
+        } else {
+            int minQuantity, maxQuantity;
+            validateRange("Quantity", minQuantity, maxQuantity);
+            ids = quantityIndex.range(minQuantity, maxQuantity, categoryChoice);
+        }
+
+        if (ids.empty()) {
+            cout << "No items in this range.\n";
+            return;
+        }
+
+        cout << "ID        ITEM           QTY     PRICE   CATEGORY\n";
+        cout << "-------------------------------------------------\n";
+        for (auto &id : ids) {
+            displayRow(findItemIndex(id));
+        }
+    }
+
+    // Method to display item counts, units and stock value per category and overall
+    void displaySummary() override {
+        if (itemCount == 0) {
+            cout << "Please add items first!\n";
+            return;
+        }
+
+        cout << "CATEGORY       ITEMS   UNITS     VALUE         MIN PRICE MAX PRICE\n";
+        cout << "------------------------------------------------------------------\n";
+        for (int id = 0; id < categories.size(); id++) {
+            const string &category = categories.name(id);
+            displaySummaryRow(category, categoryTotals[category], category);
+        }
+        cout << "------------------------------------------------------------------\n";
+        displaySummaryRow("total", totals, "");
+        cout << "Item records: " << itemCount << " x " << sizeof(Item) << " bytes = "
+             << itemCount * sizeof(Item) << " bytes (capacity " << items.capacity() << " x " << sizeof(Item) << " bytes)";
+        if (persistedInPlace()) cout << ", mapped from " << store->itemFilePath();
+        cout << "\n";
+        displayIdFilterStats();
+    }
+
+    // Method to display the k highest or lowest items by name, price or quantity
+    void displayTopItems() override {
+        if (itemCount == 0) {
+            cout << "Please add items first!\n";
+            return;
+        }
+
+        string rankChoice, categoryChoice;
+        char directionChoice;
+        int count;
+
+        cout << "[Back - 0]\n";
+
+        // Ask the user for the ranking criteria (Name, Price, Quantity)
+        while (true) {
+            cout << "Rank by [Name/Price/Quantity]: ";
+            input >> rankChoice;
+            if (rankChoice == "0") return; // Return to main menu if input is '0'
+
+            for (auto &c : rankChoice) c = tolower(c);  // Convert to lowercase for case-insensitive comparison
+
+            if (rankChoice == "name" || rankChoice == "price" || rankChoice == "quantity") {
+                break; // Valid input, exit loop
+            } else {
+                cout << "Invalid choice! Please enter 'Name', 'Price', or 'Quantity'.\n";
+            }
+        }
+
+        // Ask whether the highest or the lowest items are wanted
+        while (true) {
+            cout << "Show [T-Top/B-Bottom]: ";
+            input >> directionChoice;
+            if (directionChoice == '0') return; // Return to main menu if input is '0'
+
+            directionChoice = tolower(directionChoice);
+            if (directionChoice == 't' || directionChoice == 'b') {
+                break; // Valid input, exit loop
+            } else {
+                cout << "Invalid choice! Please enter 'T' for Top or 'B' for Bottom.\n";
+            }
+        }
+
+        // Optionally restrict the ranking to one category
+        if (!promptCategory(categoryChoice, true)) return; // Return to main menu if input is '0'
+
+        cout << "How many items: ";
+        validateInput(count);
+
+        // Top means largest first, bottom means smallest first
+        vector<int> positions;
+        withItemOrder(rankChoice, directionChoice == 'b', [&](auto order) {
+            positions = parallelSelectTopK(order, count, categoryChoice);
+        });
+
+        if (positions.empty()) {
+            cout << "No items available in this category.\n";
+            return;
+        }
+
+        cout << ((directionChoice == 't') ? "Top " : "Bottom ") << positions.size()
+             << " items by " << rankChoice << ":\n";
+        cout << "ID        ITEM           QTY     PRICE   CATEGORY\n";
+        cout << "-------------------------------------------------\n";
+        for (int i : positions) {
+            displayRow(i);
+        }
+    }
+
+    // Method to page through the inventory a screen at a time (in storage order, or in name,
+    // price or quantity order, optionally within one category)
+    void browseItems() override {
+        if (itemCount == 0) {
+            cout << "Please add items first!\n";
+            return;
+        }
+
+        string viewChoice, categoryChoice;
+        int pageSize;
+
+        cout << "[Back - 0]\n";
+
+        // Ask the user for the view (storage order or one of the ordered indexes)
+        while (true) {
+            cout << "Browse by [All/Name/Price/Quantity]: ";
+            input >> viewChoice;
+            if (viewChoice == "0") return; // Return to main menu if input is '0'
+
+            for (auto &c : viewChoice) c = tolower(c);  // Convert to lowercase for case-insensitive comparison
+
+            if (viewChoice == "all" || viewChoice == "name" || viewChoice == "price" || viewChoice == "quantity") {
+                break; // Valid input, exit loop
+            } else {
+                cout << "Invalid choice! Please enter 'All', 'Name', 'Price', or 'Quantity'.\n";
+            }
+        }
+
+        // Ordered views can be restricted to one category
+        if (viewChoice != "all") {
+            if (!promptCategory(categoryChoice, true)) return; // Return to main menu if input is '0'
+        }
+
+        cout << "Items per page: ";
+        validateInput(pageSize);
+        pageSize = min(pageSize, itemCount);  // A larger page shows everything anyway (and keeps cursor + pageSize in range)
+
+        if (viewChoice == "all") {
+            browseStorageOrder(pageSize);
+        } else if (viewChoice == "name") {
+            browseIndex(nameOrderIndex, categoryChoice, pageSize);
+        } else if (viewChoice == "price") {
+            browseIndex(priceIndex, categoryChoice, pageSize);
+        } else {
+            browseIndex(quantityIndex, categoryChoice, pageSize);
+        }
+    }
+
+    // Pages through items[] in storage order; the cursor is simply the position of the first row
+    void browseStorageOrder(int pageSize) {
+        int cursor = 0;
+        char command;
+
+        while (true) {
+            cout << "ID        ITEM           QTY     PRICE   CATEGORY\n";
+            cout << "-------------------------------------------------\n";
+            for (int i = cursor; i < min(itemCount, cursor + pageSize); i++) {
+                displayRow(i);
+            }
+            cout << "Items " << cursor + 1 << "-" << min(itemCount, cursor + pageSize) << " of " << itemCount << endl;
+
+            cout << "[N-Next/P-Prev/J-Jump to ID/0-Back]: ";
+            input >> command;
+            command = tolower(command);
+
+            if (command == '0') {
+                return;
+            } else if (command == 'n') {
+                if (pageSize < itemCount - cursor) cursor += pageSize;
+                else cout << "Already on the last page.\n";
+            } else if (command == 'p') {
+                if (cursor > 0) cursor = max(0, cursor - pageSize);
+                else cout << "Already on the first page.\n";
+            } else if (command == 'j') {
+                string id;
+                cout << "Input ID: ";
+                input >> id;
+
+                int position = findItemIndex(id);
+                if (position == -1) cout << "Item not found!\n";
+                else cursor = position;
+            } else {
+                cout << "Invalid input. Please enter 'N', 'P', 'J' or '0'.\n";
+            }
+        }
+    }
+
+    // Pages through an ordered index. The cursor is the (key, ID) entry at the edge of the
+    // current page, so each step is one O(log n) seek plus O(page size) reads.
+    template<typename KeyPolicy>
+    void browseIndex(const OrderedIndex<KeyPolicy>& index, const string& category, int pageSize) {
+        using Key = typename OrderedIndex<KeyPolicy>::Key;
+        using Entry = typename OrderedIndex<KeyPolicy>::Entry;
+        vector<Entry> page = index.firstPage(pageSize, category);
+        char command;
+
+        if (page.empty()) {
+            cout << "No items available in this category.\n";
+            return;
+        }
+
+        while (true) {
+            cout << "ID        ITEM           QTY     PRICE   CATEGORY\n";
+            cout << "-------------------------------------------------\n";
+            for (auto &entry : page) {
+                // On a replica the primary may have removed the item since the page was taken
+                int index = findItemIndex(entry.second);
+                if (index != -1) displayRow(index);
+            }
+
+            cout << "[N-Next/P-Prev/J-Jump to value/0-Back]: ";
+            input >> command;
+            command = tolower(command);
+
+            vector<Entry> nextPage;
+            if (command == '0') {
+                return;
+            } else if (command == 'n') {
+                nextPage = index.pageAfter(page.back(), pageSize, category);
+                if (nextPage.empty()) cout << "Already on the last page.\n";
+            } else if (command == 'p') {
+                nextPage = index.pageBefore(page.front(), pageSize, category);
+                if (nextPage.empty()) cout << "Already on the first page.\n";
+            } else if (command == 'j') {
+                Key key;
+                cout << "Jump to: ";
+                input >> key;
+                if (!input) {
+                    input.clear();
+                    input.ignoreLine();
+                }
+
+                nextPage = index.pageFrom(key, pageSize, category);
+                if (nextPage.empty()) cout << "No items at or after that value.\n";
+            } else {
+                cout << "Invalid input. Please enter 'N', 'P', 'J' or '0'.\n";
+            }
+
+            if (!nextPage.empty()) page = nextPage;
+        }
+    }
+
+    // Method to record a sale or a restock as a change relative to the current quantity
+    void adjustStock() override {
+        if (itemCount == 0) {
+            cout << "Please add items first!\n";
+            return;
+        }
+
+        string id;
+        char action, choice;
+        int amount;
+
+        do {
+            cout << "[Back - 0]\n";
+            cout << "Input ID: ";
+            input >> id;
+
+            if (id == "0") return;  // Exit to main menu if "0" is entered
+
+            int i = findItemIndex(id);
+            if (i == -1) {
+                cout << "Item not found!\n";
+            } else {
+                // Ask whether units leave (sale) or arrive (restock)
+                do {
+                    cout << "[S-Sell/R-Restock]: ";
+                    input >> action;
+                    action = tolower(action);
+                } while (action != 's' && action != 'r');
+
+                cout << "Units: ";
+                validateInput(amount);
+
+                int before = items[i].getQuantity();
+                AdjustResult result = adjustQuantity(id, (action == 's') ? -amount : amount);
+
+                if (result == AdjustResult::WouldGoNegative) {
+                    cout << "Only " << before << " of " << items[i].getName() << " in stock. Nothing was changed.\n";
+                } else if (result == AdjustResult::WouldOverflow) {
+                    cout << "The stock of " << items[i].getName() << " cannot exceed " << numeric_limits<int32_t>::max()
+                         << " units. Nothing was changed.\n";
+                } else {
+                    cout << items[i].getName() << " Quantity updated from " << before
+                         << " --> " << items[i].getQuantity() << endl;
+                }
+            }
+
+            // Ask if they want to adjust another item
+            cout << "Adjust another item? [Y/N]: ";
+            input >> choice;
+
+        } while (tolower(choice) == 'y');
+    }
+
+    // Method to apply many quantity/price changes at once (e.g. when a shipment arrives)
+    void receiveShipment() override {
+        if (itemCount == 0) {
+            cout << "Please add items first!\n";
+            return;
+        }
+
+        vector<ItemChange> changes;
+        string id, quantityText, priceText, error;
+        char choice;
+
+        cout << "[Back - 0]\n";
+        cout << "Enter one change per line as: ID Quantity Price (use - to keep a value). Enter 0 when done.\n";
+
+        while (true) {
+            cout << "Change " << changes.size() + 1 << ": ";
+            input >> id;
+            if (id == "0") break;
+            input >> quantityText >> priceText;
+
+            ItemChange change;
+            change.id = id;
+
+            if (quantityText != "-") {
+                change.hasQuantity = true;
+                if (!parseQuantity(quantityText, change.quantity) || change.quantity == 0) {
+                    cout << "Invalid quantity! Please re-enter this line.\n";
+                    continue;
+                }
+            }
+            if (priceText != "-") {
+                change.hasPrice = true;
+                if (!parsePrice(priceText, change.price) || change.price == 0) {
+                    cout << "Invalid price! Please re-enter this line.\n";
+                    continue;
+                }
+            }
+            changes.push_back(change);
+        }
+
+        if (changes.empty()) return;  // Nothing entered, back to main menu
+
+        do {
+            cout << "Apply " << changes.size() << " change(s)? [Y/N]: ";
+            input >> choice;
+            choice = tolower(choice);
+        } while (choice != 'y' && choice != 'n');
+
+        if (choice == 'n') {
+            cout << "No changes were made.\n";
+        } else if (applyBatch(changes, error)) {
+            cout << changes.size() << " change(s) applied.\n";
+        } else {
+            cout << error << ". No changes were made.\n";
+        }
+    }
+
+    // Method to save the items changed since the last checkpoint
+    void saveCheckpoint() override {
+        if (store == nullptr) {
+            cout << "This inventory is not persisted.\n";
+            return;
+        }
 
-public:
-    // Constructor
-    Item(string itemId = "", string itemName = "", int itemQuantity = 0, double itemPrice = 0.0, string itemCategory = "")
-            : id(itemId), name(itemName), quantity(itemQuantity), price(itemPrice), category(itemCategory) {}
+        int written = writeCheckpoint();
+        if (store->takeBackgroundFailure()) {
+            cout << "The last background snapshot or merge could not be written. The files it started from were kept.\n";
+        }
+        if (written == -1) {
+            cout << "Saving failed: " << (persistedInPlace() ? store->itemFilePath() : store->deltaPath())
+                 << " could not be written. The changes are kept for the next save.\n";
+        } else if (written == 0) {
+            cout << "No changes since the last save.\n";
+        } else {
+            cout << written << " changed item(s) saved.\n";
+        }
+    }
 
-    // Getters and setters for encapsulation
-    string getId() const { return id; }
-    void setId(string newId) { id = newId; }
+    // Method to write a full snapshot of the inventory, with the disk writes in the background
+    void saveSnapshot() override {
+        if (store == nullptr) {
+            cout << "This inventory is not persisted.\n";
+            return;
+        }
 
-    string getName() const { return name; }
-    void setName(string newName) { name = newName; }
+        // The point-in-time copy is a full copy of the records taken here (one memcpy of
+        // itemCount x 64 bytes, not copy-on-write), so this pause grows with the inventory;
+        // encoding and writing then happen on the store's background thread
+        vector<Item> capture(items.data(), items.data() + itemCount);
 
-    int getQuantity() const { return quantity; }
-    void setQuantity(int newQuantity) { quantity = newQuantity; }
+        // Pending changes go to the deltas first rather than being dropped as part of the
+        // snapshot, so they survive if the snapshot cannot be written
+        writeCheckpoint();
+        store->writeSnapshotAsync(move(capture));
+        if (store->takeBackgroundFailure()) {
+            cout << "The last background snapshot or merge could not be written. The files it started from were kept.\n";
+        }
+        cout << "Snapshot of " << itemCount << " item(s) is being saved in the background.\n";
+    }
 
-    double getPrice() const { return price; }
-    void setPrice(double newPrice) { price = newPrice; }
+    // Prints one item as a row of the ID/ITEM/QTY/PRICE/CATEGORY table
+    void displayRow(int i) const {
+        cout << left << setw(10) << items[i].getId()
+             << setw(15) << items[i].getName()
+             << setw(8) << items[i].getQuantity()
+             << setw(8) << items[i].getPrice()
+             << setw(10) << items[i].getCategory() << endl;
+    }
 
-    string getCategory() const { return category; }
-    void setCategory(string newCategory) { category = newCategory; }
+    // Prints one line of the summary table; min/max prices come from the ordered price index
+    void displaySummaryRow(const string& label, const StockTotals& row, const string& category) const {
+        double minPrice, maxPrice;
 
-    // Method to display item details (abstraction for the user)
-    void displayItem() const {
-        cout << "ID: " << id << ", Name: " << name
-             << ", Quantity: " << quantity << ", Price: " << price
-             << ", Category: " << category << endl;
+        cout << left << setw(15) << label
+             << setw(8) << row.itemCount
+             << setw(9) << row.totalUnits << ' '
+             << setw(13) << formatCents(row.totalValue) << ' ';
+        if (priceIndex.bounds(minPrice, maxPrice, category)) {
+            cout << setw(9) << minPrice << ' ' << setw(10) << maxPrice << endl;
+        } else {
+            cout << setw(10) << "-" << setw(10) << "-" << endl;
+        }
     }
 };
 
-// Base Inventory class
-class BaseInventory {
-public:
-    virtual void addItem() = 0;
-    virtual void updateItem() = 0;
-    virtual void removeItem() = 0;
-    virtual void displayItemsByCategory() = 0;
-    virtual void displayAllItems() = 0;
-    virtual void searchItem() = 0;
-    virtual void sortItems() = 0;
-    virtual void displayLowStockItems() = 0;
-};
+// The storage layout is picked per build: INVENTORY_STORAGE_VECTOR selects the growable
+// vector, INVENTORY_STORAGE_MAPPED a memory-mapped item file, otherwise records live in a
+// fixed array of 100
+#if defined(INVENTORY_STORAGE_VECTOR)
+using Inventory = BasicInventory<GrowableItemVector>;
+#elif defined(INVENTORY_STORAGE_MAPPED)
+using Inventory = BasicInventory<MappedItemFile>;
+#else
+using Inventory = BasicInventory<FixedItemArray<100>>;
+#endif
 
-// Class representing the inventory (manages multiple items)
-class Inventory : public BaseInventory {
+// Several warehouses, each held as its own Inventory partition with its own store on disk.
+// Item IDs are scoped per warehouse: the same ID may be stocked in several warehouses, each
+// with its own record, quantity and price. Menu operations work on the current warehouse;
+// reports fan out to one thread per warehouse and merge the partial results, listing (or
+// counting) every record, so an ID stocked in two warehouses appears twice.
+class PartitionedInventory {
 public:
-    static const int MAX_ITEMS = 100;  // Fixed array size
-    Item items[MAX_ITEMS];             // Array of Item objects
-    int itemCount;                     // Track the number of items in inventory
+    // One partition: a named warehouse with its inventory and checkpoint store
+    struct Warehouse {
+        string name;
+        unique_ptr<CheckpointStore> store;
+        unique_ptr<Inventory> inventory;
+    };
 
-    // Constructor
-    Inventory() : itemCount(0) {}
+    // An item found by a cross-warehouse report, tagged with the warehouse holding it
+    struct Located {
+        int warehouse;
+        Item item;
+    };
 
-    // Method to validate numeric input
-    template<typename T>
-    void validateInput(T& value) {
-        while (!(cin >> value) || value <= 0) {
-            cout << "Invalid input. Please enter a positive value: ";
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+private:
+    vector<Warehouse> warehouses;
+
+    // Runs task(warehouseIndex, inventory) for every warehouse on its own thread and returns
+    // the results in warehouse order
+    template<typename Result, typename Task>
+    vector<Result> fanOut(Task task) {
+        vector<Result> results(warehouses.size());
+        vector<thread> workers;
+
+        for (size_t w = 0; w < warehouses.size(); w++) {
+            workers.emplace_back([&, w]() {
+                results[w] = task(w, *warehouses[w].inventory);
+            });
         }
+        for (auto &worker : workers) worker.join();
+        return results;
     }
 
-    // Method to add a new item to the inventory
-    void addItem() override {
-        string id, name, category;
-        int quantity;
-        double price;
-        char choice;
+    // Merges per-warehouse lists that are each already in the given order
+    template<typename Compare>
+    static vector<Located> mergeSorted(const vector<vector<Located>>& lists, Compare before) {
+        vector<Located> merged;
+        vector<size_t> heads(lists.size(), 0);
 
         while (true) {
-            cout << "[Back - 0]\n";
-            cout << "Input Category (Clothing, Electronics, Entertainment): ";
-            cin >> category;
+            int best = -1;
+            for (size_t l = 0; l < lists.size(); l++) {
+                if (heads[l] < lists[l].size() &&
+                    (best == -1 || before(lists[l][heads[l]].item, lists[best][heads[best]].item))) {
+                    best = l;
+                }
+            }
+            if (best == -1) return merged;
+            merged.push_back(lists[best][heads[best]++]);
+        }
+    }
 
-            // Check for exit option
-            if (category == "0") {
-                return; // Go back to main menu
+public:
+    // Store path of a warehouse: the first keeps the plain base path so a single-warehouse
+    // setup uses the same files as before, the others add their lowercased name
+    static string storePath(const string& basePath, const vector<string>& names, int w) {
+        string path = basePath;
+        if (w > 0) {
+            path += "-";
+            for (char c : names[w]) path += tolower(c);
+        }
+        return path;
+    }
+
+    // Opens one partition per warehouse name. An empty base path keeps the partitions in
+    // memory only.
+    void open(const vector<string>& names, const string& basePath) {
+        for (size_t w = 0; w < names.size(); w++) {
+            Warehouse warehouse;
+            warehouse.name = names[w];
+            warehouse.inventory.reset(new Inventory());
+
+            if (!basePath.empty()) {
+                warehouse.store.reset(new CheckpointStore(storePath(basePath, names, w)));
+                int skipped = warehouse.inventory->attachStore(*warehouse.store);
+                if (skipped > 0) {
+                    cout << skipped << " saved item(s) of " << names[w] << " could not be loaded. Inventory is full.\n";
+                }
             }
+            warehouses.push_back(move(warehouse));
+        }
+    }
 
-            // Convert to lowercase for case-insensitive comparison
-            for (auto &c : category) c = tolower(c);
+    int size() const { return warehouses.size(); }
+    const string& name(int w) const { return warehouses[w].name; }
+    Inventory& inventory(int w) { return *warehouses[w].inventory; }
 
-            // Validate the category
-            if (category != "clothing" && category != "electronics" && category != "entertainment") {
-                cout << "Invalid category! Please enter a valid category.\n";
-            } else {
-                break; // Valid category, exit the loop
+    // Returns every warehouse holding a record with the given ID, with its position in each
+    vector<pair<int, int>> locate(const string& id) const {
+        vector<pair<int, int>> owners;
+        for (size_t w = 0; w < warehouses.size(); w++) {
+            int position = warehouses[w].inventory->findItemIndex(id);
+            if (position != -1) owners.push_back({(int) w, position});
+        }
+        return owners;
+    }
+
+    // Per-warehouse totals, gathered in parallel
+    vector<StockTotals> warehouseTotals() {
+        return fanOut<StockTotals>([](int, Inventory& inventory) {
+            return inventory.totals;
+        });
+    }
+
+    // Totals of one category summed over all warehouses
+    StockTotals categoryTotals(const string& category) {
+        StockTotals combined;
+        for (auto &partial : fanOut<StockTotals>([&](int, Inventory& inventory) {
+            auto it = inventory.categoryTotals.find(category);
+            return (it == inventory.categoryTotals.end()) ? StockTotals() : it->second;
+        })) {
+            combined.itemCount += partial.itemCount;
+            combined.totalUnits += partial.totalUnits;
+            combined.totalValue += partial.totalValue;
+        }
+        return combined;
+    }
+
+    // Items at or below the threshold in every warehouse
+    vector<Located> lowStock(int threshold) {
+        vector<Located> merged;
+        for (auto &partial : fanOut<vector<Located>>([&](int w, Inventory& inventory) {
+            vector<Located> found;
+            for (auto &id : inventory.quantityIndex.range(numeric_limits<int>::min(), threshold)) {
+                found.push_back({w, inventory.items[inventory.findItemIndex(id)]});
+            }
+            return found;
+        })) {
+            merged.insert(merged.end(), partial.begin(), partial.end());
+        }
+        return merged;
+    }
+
+    // Items of one category from every warehouse, in name order
+    vector<Located> itemsInCategory(const string& category) {
+        return mergeSorted(fanOut<vector<Located>>([&](int w, Inventory& inventory) {
+            vector<Located> found;
+            for (auto &entry : inventory.nameOrderIndex.firstPage(inventory.itemCount, category)) {
+                found.push_back({w, inventory.items[inventory.findItemIndex(entry.second)]});
             }
+            return found;
+        }), ItemOrder<ByName, Ascending>());
+    }
+
+    // All items of all warehouses in the given order: each warehouse selects its own items in
+    // order on its own thread, then the sorted lists are merged
+    vector<Located> sorted(const string& key, bool ascending, size_t limit) {
+        vector<Located> merged;
+        withItemOrder(key, ascending, [&](auto order) {
+            merged = mergeSorted(fanOut<vector<Located>>([&](int w, Inventory& inventory) {
+                vector<Located> found;
+                for (int position : inventory.selectTopK(order, limit)) {
+                    found.push_back({w, inventory.items[position]});
+                }
+                return found;
+            }), order);
+        });
+        if (merged.size() > limit) merged.resize(limit);
+        return merged;
+    }
+
+    // Writes a checkpoint for every warehouse; returns the number of items saved
+    int saveAll() {
+        int written = 0;
+        for (auto &warehouse : warehouses) {
+            int saved = warehouse.inventory->writeCheckpoint();
+            if (saved == -1) cout << "Saving " << warehouse.name << " failed. Its changes could not be written.\n";
+            else written += saved;
         }
+        return written;
+    }
 
+    // Method to display reports that span all warehouses
+    void displayWarehouseReport() {
+        string reportChoice;
+
+        cout << "[Back - 0]\n";
         while (true) {
-            cout << "Input ID: ";
-            cin >> id;
+            cout << "Report [Summary/LowStock/Category/Sorted/Locate]: ";
+            input >> reportChoice;
+            if (reportChoice == "0") return; // Return to main menu if input is '0'
 
-            // Check if the user entered "0" as the item ID
-            if (id == "0") {
-                cout << "ID cannot be 0. Please enter a valid ID.\n";
-                continue; // Prompt for the ID again
+            for (auto &c : reportChoice) c = tolower(c);  // Convert to lowercase for case-insensitive comparison
+
+            if (reportChoice == "summary" || reportChoice == "lowstock" || reportChoice == "category" ||
+                reportChoice == "sorted" || reportChoice == "locate") {
+                break; // Valid input, exit loop
+            } else {
+                cout << "Invalid choice! Please enter 'Summary', 'LowStock', 'Category', 'Sorted', or 'Locate'.\n";
             }
+        }
 
-            // Check for existing ID
-            bool idExists = false;
-            for (int i = 0; i < itemCount; i++) {
-                if (items[i].getId() == id) {
-                    idExists = true;
-                    break;
-                }
+        if (reportChoice == "summary") {
+            displayWarehouseSummary();
+        } else if (reportChoice == "lowstock") {
+            cout << "Low stock items (Quantity <= " << Inventory::LOW_STOCK_THRESHOLD << ") in all warehouses:\n";
+            displayLocated(lowStock(Inventory::LOW_STOCK_THRESHOLD));
+        } else if (reportChoice == "category") {
+            string categoryChoice;
+            if (!inventory(0).promptCategory(categoryChoice, false)) return;
+            displayLocated(itemsInCategory(categoryChoice));
+        } else if (reportChoice == "sorted") {
+            string sortChoice;
+            char orderChoice;
+            int count;
+
+            while (true) {
+                cout << "Sort by [Name/Price/Quantity]: ";
+                input >> sortChoice;
+                for (auto &c : sortChoice) c = tolower(c);
+                if (sortChoice == "name" || sortChoice == "price" || sortChoice == "quantity") break;
+                cout << "Invalid choice! Please enter 'Name', 'Price', or 'Quantity'.\n";
             }
+            do {
+                cout << "Sort in [A-Ascending/D-Descending]: ";
+                input >> orderChoice;
+                orderChoice = tolower(orderChoice);
+            } while (orderChoice != 'a' && orderChoice != 'd');
 
-            if (idExists) {
-                cout << "Item already in inventory. Please enter a different ID.\n";
-            } else {
-                break; // ID is unique and valid, exit the loop
+            cout << "How many items: ";
+            inventory(0).validateInput(count);
+            displayLocated(sorted(sortChoice, orderChoice == 'a', count));
+        } else {
+            string id;
+            cout << "Input ID: ";
+            input >> id;
+
+            vector<pair<int, int>> owners = locate(id);
+            if (owners.empty()) {
+                cout << "Item not found!\n";
+                return;
             }
+            vector<Located> found;
+            for (auto &owner : owners) found.push_back({owner.first, inventory(owner.first).items[owner.second]});
+            displayLocated(found);
         }
+    }
 
-        cout << "Input Name: ";
-        cin >> name;
+    // Per-warehouse and per-category totals for all warehouses
+    void displayWarehouseSummary() {
+        vector<StockTotals> perWarehouse = warehouseTotals();
+        StockTotals combined;
 
-        // Validate quantity and price input
-        cout << "Quantity: ";
-        validateInput(quantity);
+        cout << "WAREHOUSE      RECORDS UNITS     VALUE\n";
+        cout << "--------------------------------------------\n";
+        for (int w = 0; w < size(); w++) {
+            displayTotalsRow(name(w), perWarehouse[w]);
+            combined.itemCount += perWarehouse[w].itemCount;
+            combined.totalUnits += perWarehouse[w].totalUnits;
+            combined.totalValue += perWarehouse[w].totalValue;
+        }
+        cout << "--------------------------------------------\n";
+        for (int id = 0; id < categories.size(); id++) {
+            displayTotalsRow(categories.name(id), categoryTotals(categories.name(id)));
+        }
+        cout << "--------------------------------------------\n";
+        displayTotalsRow("total", combined);
 
-        cout << "Price: ";
-        validateInput(price);
+        // IDs are per warehouse, so records can outnumber the distinct IDs
+        unordered_set<string> distinctIds;
+        for (auto &warehouse : warehouses) {
+            for (auto &entry : warehouse.inventory->idIndex) distinctIds.insert(entry.first);
+        }
+        cout << "Records are per warehouse; " << distinctIds.size() << " distinct item ID(s) in all.\n";
+    }
 
-        // Check if we can add more items
-        if (itemCount < MAX_ITEMS) {
-            items[itemCount++] = Item(id, name, quantity, price, category);  // Add item to the inventory
-            cout << "Item added successfully!\n";
+    static void displayTotalsRow(const string& label, const StockTotals& row) {
+        cout << left << setw(15) << label
+             << setw(8) << row.itemCount
+             << setw(9) << row.totalUnits << ' '
+             << formatCents(row.totalValue) << endl;
+    }
+
+    // Prints items found across warehouses as a table with a WAREHOUSE column
+    void displayLocated(const vector<Located>& found) {
+        if (found.empty()) {
+            cout << "No items found.\n";
+            return;
+        }
+
+        cout << "WAREHOUSE      ID        ITEM           QTY     PRICE   CATEGORY\n";
+        cout << "----------------------------------------------------------------\n";
+        for (auto &entry : found) {
+            cout << left << setw(15) << name(entry.warehouse)
+                 << setw(10) << entry.item.getId()
+                 << setw(15) << entry.item.getName()
+                 << setw(8) << entry.item.getQuantity()
+                 << setw(8) << entry.item.getPrice()
+                 << setw(10) << entry.item.getCategory() << endl;
+        }
+    }
+};
+
+// Reads warehouse names, one per line; a single "Main" warehouse if the file is missing or empty.
+// Names become part of store file names, so only letters, digits, '-' and '_' are accepted,
+// and names that differ only in letter case (the same files) are skipped.
+vector<string> loadWarehouseNames(const string& path) {
+    vector<string> names;
+    ifstream file(path);
+    string line;
+
+    while (getline(file, line)) {
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty() || line[0] == '#') continue;
+
+        bool usable = line.size() <= 64;
+        for (unsigned char c : line) usable = usable && (isalnum(c) || c == '-' || c == '_');
+        if (!usable) {
+            cerr << "Skipping warehouse '" << line << "' in " << path
+                 << ": use up to 64 letters, digits, '-' or '_'.\n";
+        } else if (any_of(names.begin(), names.end(), [&](const string& name) {
+            return strcasecmp(name.c_str(), line.c_str()) == 0;
+        })) {
+            cerr << "Skipping warehouse '" << line << "' in " << path << ": the name is already used.\n";
         } else {
-            cout << "Cannot add more items. Inventory is full.\n";
+            names.push_back(line);
         }
+    }
 
-        // Ensure only valid inputs for 'add another item'
-        do {
-            cout << "Add another item? [Y/N]: ";
-            cin >> choice;
-            choice = toupper(choice);
-            if (choice == 'Y') {
-                addItem();
-                break;
-            } else if (choice == 'N') {
-                break;
+    if (names.empty()) names.push_back("Main");
+    return names;
+}
+
+// Largest frame either side accepts; a length above it means a broken or hostile peer
+constexpr uint32_t MAX_FRAME_SIZE = 1u << 30;
+
+// Prefixes a payload with its length, as sent on the replication socket
+string encodeFrame(const string& payload) {
+    string frame;
+    uint32_t size = payload.size();
+    frame.append((const char*) &size, sizeof(size));
+    frame.append(payload);
+    return frame;
+}
+
+// Sends one length-prefixed frame over a blocking socket; returns false if the peer is gone
+bool sendFrame(int fd, const string& payload) {
+    string frame = encodeFrame(payload);
+    for (size_t sent = 0; sent < frame.size();) {
+        ssize_t n = send(fd, frame.data() + sent, frame.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Receives one frame written by sendFrame(); returns false on disconnect or an oversized frame
+bool receiveFrame(int fd, string& payload) {
+    auto receiveAll = [fd](char* out, size_t size) {
+        for (size_t received = 0; received < size;) {
+            ssize_t n = recv(fd, out + received, size - received, 0);
+            if (n <= 0) return false;
+            received += n;
+        }
+        return true;
+    };
+
+    uint32_t size;
+    if (!receiveAll((char*) &size, sizeof(size)) || size > MAX_FRAME_SIZE) return false;
+    payload.resize(size);
+    return receiveAll(payload.data(), size);
+}
+
+// Log shipping from a primary process to read-only replicas over a local (Unix domain) socket.
+// Every change published by a warehouse gets the next sequence number and is sent to every
+// connected replica in order. Frames are RecordWriter payloads:
+//   'S' seq, warehouse count, per warehouse: name, item count, items   (catch-up snapshot)
+//   'C' seq, warehouse, event type, id, name, category, old/new quantity, new price
+//   'H' seq                                          (heartbeat, sent once a second)
+//   'A' seq                                          (replica -> primary: applied up to seq)
+// Snapshots are built under inventoryMutex right after shipping every pending change, so
+// they are exactly the state after the last shipped change; the lock is released before
+// anything is sent. Replica sockets are non-blocking: each replica has a bounded queue that
+// the shipper drains as the socket accepts data, and a replica that falls too far behind is
+// disconnected instead of holding up the primary or the other replicas.
+class ReplicationPrimary {
+private:
+    struct Replica {
+        int fd;
+        uint64_t appliedSequence;
+        string outbox;  // Encoded frames not yet accepted by the socket
+        string inbox;   // Bytes of acknowledgements received so far
+    };
+
+    PartitionedInventory &warehouses;
+    mutex &inventoryMutex;
+    string socketPath;
+    int listenFd = -1;
+    vector<ChangeFeed::Subscription*> feeds;
+    vector<Replica> replicas;
+    mutex replicasMutex;  // replicas is read by displayStatus() on the menu thread
+    atomic<uint64_t> sequence{0};
+    atomic<uint64_t> disconnectedSlow{0};  // Replicas dropped because their queue overflowed
+    atomic<bool> stopping{false};
+    thread shipper;
+
+    static constexpr size_t FEED_CAPACITY = 1 << 16;
+    static constexpr size_t MAX_QUEUED_BYTES = 64 << 20;  // Per replica, not counting a fresh snapshot
+
+    // Queues a frame for one replica; returns false if the replica is too far behind to keep
+    // (a snapshot queued on an empty outbox is always accepted)
+    static bool enqueue(Replica& replica, const string& frame) {
+        if (replica.outbox.size() > MAX_QUEUED_BYTES) return false;
+        replica.outbox += frame;
+        return true;
+    }
+
+    // Sends as much of the replica's queue as its socket takes without blocking; returns
+    // false if the replica disconnected
+    static bool flush(Replica& replica) {
+        size_t sent = 0;
+        while (sent < replica.outbox.size()) {
+            ssize_t n = send(replica.fd, replica.outbox.data() + sent, replica.outbox.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (n <= 0) return false;
+            sent += n;
+        }
+        replica.outbox.erase(0, sent);
+        return true;
+    }
+
+    // Takes whatever acknowledgements arrived; returns false if the replica disconnected
+    static bool readAcks(Replica& replica) {
+        char block[4096];
+        while (true) {
+            ssize_t n = recv(replica.fd, block, sizeof(block), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (n <= 0) return false;
+            replica.inbox.append(block, n);
+        }
+
+        while (replica.inbox.size() >= sizeof(uint32_t)) {
+            uint32_t size;
+            memcpy(&size, replica.inbox.data(), sizeof(size));
+            if (size > 64) return false;  // Acknowledgements are tiny
+            if (replica.inbox.size() < sizeof(size) + size) break;
+
+            RecordReader reader(replica.inbox.data() + sizeof(size), size);
+            if (reader.getByte() == 'A') {
+                uint64_t applied = reader.getUint64();
+                if (reader.ok) replica.appliedSequence = applied;
+            }
+            replica.inbox.erase(0, sizeof(size) + size);
+        }
+        return true;
+    }
+
+    void disconnect(size_t r) {
+        close(replicas[r].fd);
+        replicas.erase(replicas.begin() + r);
+    }
+
+    // Queues a frame for every replica, dropping the ones that fell too far behind
+    void broadcast(const string& payload) {
+        string frame = encodeFrame(payload);
+        lock_guard<mutex> lock(replicasMutex);
+        for (size_t r = 0; r < replicas.size();) {
+            if (enqueue(replicas[r], frame)) {
+                r++;
             } else {
-                cout << "Invalid input. Please enter 'Y' or 'N'.\n";
+                disconnectedSlow++;
+                disconnect(r);
             }
-        } while (true);
+        }
     }
 
-    // Method to update an item's quantity or price
-    void updateItem() override {
-        if (itemCount == 0) {
-            cout << "Please add items first!\n";
-            return;
+    // Ships every change waiting in the warehouse feeds
+    void shipChanges() {
+        ChangeEvent event;
+        for (size_t w = 0; w < feeds.size(); w++) {
+            while (feeds[w]->events.pop(event)) {
+                RecordWriter writer;
+                writer.putByte('C');
+                writer.putUint64(++sequence);
+                writer.putUint32(w);
+                writer.putByte(event.type);
+                writer.putString(event.id);
+                writer.putString(event.name);
+                writer.putString(event.category);
+                writer.putInt32(event.oldQuantity);
+                writer.putInt32(event.newQuantity);
+                writer.putDouble(event.newPrice);
+                broadcast(writer.buffer);
+            }
         }
+    }
 
-        string id, updateChoice;
-        int newQuantity;
-        double newPrice;
-        char choice;
-        bool itemFound;
+    // Full copy of every warehouse at the current sequence; call with inventoryMutex held
+    string snapshotFrame() {
+        RecordWriter writer;
+        writer.putByte('S');
+        writer.putUint64(sequence);
+        writer.putUint32(warehouses.size());
+        for (int w = 0; w < warehouses.size(); w++) {
+            Inventory &inventory = warehouses.inventory(w);
+            writer.putString(warehouses.name(w));
+            writer.putUint32(inventory.itemCount);
+            for (int i = 0; i < inventory.itemCount; i++) writer.putItem(inventory.items[i]);
+        }
+        return writer.buffer;
+    }
 
-        do {
-            itemFound = false; // Reset for each loop
+    // Ships what is pending and captures a snapshot at that point; only this part holds
+    // inventoryMutex, the snapshot is queued after it is released
+    string captureSnapshot() {
+        lock_guard<mutex> lock(inventoryMutex);
+        shipChanges();
+        return encodeFrame(snapshotFrame());
+    }
 
-            cout << "[Back - 0]\n";
-            cout << "Input ID: ";
-            cin >> id;
+    // Brings a new replica up to date: ship what is pending, then queue it a snapshot
+    void acceptReplica() {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd == -1) return;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
 
-            if (id == "0") return; // Exit if user inputs "0"
+        string snapshot = captureSnapshot();
+        lock_guard<mutex> replicasLock(replicasMutex);
+        replicas.push_back({fd, sequence, move(snapshot), ""});
+    }
 
-            // Searching for the item with the given ID
-            for (int i = 0; i < itemCount; i++) {
-                if (items[i].getId() == id) {
-                    itemFound = true;
-                    do {
-                        cout << "What to update? [Qty/Price]: ";
-                        cin >> updateChoice;
-                        // Convert to lowercase for case-insensitive comparison
-                        for (auto &c : updateChoice) c = tolower(c);
-
-                        if (updateChoice == "qty") {
-                            cout << "New Quantity: ";
-                            validateInput(newQuantity);
-
-                            if (newQuantity == items[i].getQuantity()) {
-                                cout << "The Quantity of " << items[i].getName() << " is already " << newQuantity << endl;
-                            } else {
-                                cout << items[i].getName() << " Quantity updated from " << items[i].getQuantity();
-                                items[i].setQuantity(newQuantity);
-                                cout << " --> " << items[i].getQuantity() << endl;
-                            }
-                        } else if (updateChoice == "price") {
-                            cout << "New Price: ";
-                            validateInput(newPrice);
-
-                            if (newPrice == items[i].getPrice()) {
-                                cout << "The Price of " << items[i].getName() << " is already " << newPrice << endl;
-                            } else {
-                                cout << items[i].getName() << " Price updated from " << items[i].getPrice();
-                                items[i].setPrice(newPrice);
-                                cout << " --> " << items[i].getPrice() << endl;
-                            }
-                        } else {
-                            cout << "Invalid choice! Please enter 'Qty' or 'Price'.\n";
-                        }
-                    } while (updateChoice != "qty" && updateChoice != "price");
-                    break;
+    // If a feed overflowed, changes were lost: resend a full snapshot to every replica
+    void resyncIfDropped() {
+        bool dropped = false;
+        for (auto feed : feeds) {
+            if (feed->dropped.exchange(0) > 0) dropped = true;
+        }
+        if (!dropped) return;
+
+        string snapshot = captureSnapshot();
+        lock_guard<mutex> lock(replicasMutex);
+        for (size_t r = 0; r < replicas.size();) {
+            // Whatever is still queued is superseded only once the replica has it all, so the
+            // snapshot goes after it; a replica that cannot take it is dropped
+            if (enqueue(replicas[r], snapshot)) {
+                r++;
+            } else {
+                disconnectedSlow++;
+                disconnect(r);
+            }
+        }
+    }
+
+    void run() {
+        auto lastHeartbeat = chrono::steady_clock::now();
+
+        while (!stopping) {
+            vector<pollfd> fds = {{listenFd, POLLIN, 0}};
+            {
+                lock_guard<mutex> lock(replicasMutex);
+                for (auto &replica : replicas) {
+                    fds.push_back({replica.fd, (short) (POLLIN | (replica.outbox.empty() ? 0 : POLLOUT)), 0});
                 }
             }
+            poll(fds.data(), fds.size(), 100);
 
-            if (!itemFound) {
-                cout << "Item not found!\n";
+            if (fds[0].revents & POLLIN) acceptReplica();
+
+            resyncIfDropped();
+            shipChanges();
+            if (chrono::steady_clock::now() - lastHeartbeat >= chrono::seconds(1)) {
+                RecordWriter heartbeat;
+                heartbeat.putByte('H');
+                heartbeat.putUint64(sequence);
+                broadcast(heartbeat.buffer);
+                lastHeartbeat = chrono::steady_clock::now();
             }
 
-            // Ask if they want to update another item
-            cout << "Update another item? [Y/N]: ";
-            cin >> choice;
+            // Every socket operation is non-blocking, so holding replicasMutex here is brief
+            lock_guard<mutex> lock(replicasMutex);
+            for (size_t r = 0; r < replicas.size();) {
+                if (readAcks(replicas[r]) && flush(replicas[r])) r++;
+                else disconnect(r);
+            }
+        }
+    }
 
-        } while (tolower(choice) == 'y');
+public:
+    ReplicationPrimary(PartitionedInventory& inventories, mutex& lock, const string& path)
+            : warehouses(inventories), inventoryMutex(lock), socketPath(path) {
+        // Subscribe before any thread starts mutating
+        for (int w = 0; w < warehouses.size(); w++) {
+            feeds.push_back(warehouses.inventory(w).changeFeed.subscribe(ChangeFeed::AllItems, "", 0, FEED_CAPACITY));
+        }
     }
 
-    // Method to remove an item from the inventory
-    void removeItem() override {
-        if (itemCount == 0) {
-            cout << "Please add items first!\n";
-            return;
+    ~ReplicationPrimary() { stop(); }
+
+    // Starts listening for replicas; returns false if the socket cannot be created
+    bool start() {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path)) return false;
+        strcpy(address.sun_path, socketPath.c_str());
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd == -1) return false;
+
+        unlink(socketPath.c_str());  // Left behind by a primary that did not exit cleanly
+        if (bind(listenFd, (sockaddr*) &address, sizeof(address)) == -1 || listen(listenFd, 8) == -1) {
+            close(listenFd);
+            listenFd = -1;
+            return false;
         }
 
-        string id;
-        char choice;
-        bool itemFound = false;
+        shipper = thread(&ReplicationPrimary::run, this);
+        return true;
+    }
+
+    // Ships whatever the last command changed, gives the replicas up to a second to take
+    // their queues, then closes the connections
+    void stop() {
+        if (listenFd == -1) return;
+
+        stopping = true;
+        shipper.join();
+        shipChanges();
+
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(1);
+        while (chrono::steady_clock::now() < deadline) {
+            vector<pollfd> fds;
+            for (size_t r = 0; r < replicas.size();) {
+                if (!flush(replicas[r])) {
+                    disconnect(r);
+                    continue;
+                }
+                if (!replicas[r].outbox.empty()) fds.push_back({replicas[r].fd, POLLOUT, 0});
+                r++;
+            }
+            if (fds.empty()) break;
+            poll(fds.data(), fds.size(), 100);
+        }
+
+        for (auto &replica : replicas) close(replica.fd);
+        replicas.clear();
+        close(listenFd);
+        listenFd = -1;
+        unlink(socketPath.c_str());
+    }
+
+    // Method to display the replication state for the stats screen
+    void displayStatus() {
+        lock_guard<mutex> lock(replicasMutex);
+        cout << "Replication: primary on " << socketPath << ", sequence " << sequence << ", "
+             << replicas.size() << " replica(s)";
+        if (disconnectedSlow > 0) cout << ", " << disconnectedSlow << " disconnected for falling behind";
+        cout << "\n";
+        for (size_t r = 0; r < replicas.size(); r++) {
+            cout << "  Replica " << r + 1 << ": applied " << replicas[r].appliedSequence
+                 << ", lag " << sequence - replicas[r].appliedSequence << " change(s), "
+                 << replicas[r].outbox.size() << " byte(s) queued\n";
+        }
+    }
+};
+
+// Read-only copy of a primary's warehouses. connect() receives the catch-up snapshot; a
+// background thread then applies the shipped changes in order under inventoryMutex, and
+// acknowledges each one so the primary can report lag.
+class ReplicationReplica {
+private:
+    PartitionedInventory &warehouses;
+    mutex &inventoryMutex;
+    string socketPath;
+    int fd = -1;
+    atomic<uint64_t> appliedSequence{0};
+    atomic<uint64_t> primarySequence{0};
+    atomic<long long> lastHeardMs{0};
+    atomic<bool> connected{false};
+    string failure;  // Why the primary's stream was rejected, set before connected drops
+    thread receiver;
+
+    static long long nowMs() {
+        return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Replaces the contents of every warehouse with the snapshot; opens them on first use
+    void applySnapshot(RecordReader& reader) {
+        uint32_t count = reader.getUint32();
+        bool first = warehouses.size() == 0;
+        vector<string> names;
+        vector<vector<Item>> contents;  // Grown as warehouses arrive: count is not trusted
+
+        for (uint32_t w = 0; w < count && reader.ok; w++) {
+            names.push_back(reader.getString());
+            contents.emplace_back();
+            uint32_t itemCount = reader.getUint32();
+            for (uint32_t i = 0; i < itemCount && reader.ok; i++) contents[w].push_back(reader.getItem());
+        }
+        if (!reader.ok) return;
+
+        if (first) warehouses.open(names, "");
+        // Without change events, so a resync does not repeat low stock alerts already shown
+        for (int w = 0; w < min((int) count, warehouses.size()); w++) {
+            warehouses.inventory(w).replaceItems(contents[w]);
+        }
+    }
+
+    // Applies one shipped change. Quantities are applied as deltas, so concurrent sales on the
+    // primary give the same result whatever order their events were published in.
+    void applyChange(RecordReader& reader) {
+        uint32_t w = reader.getUint32();
+        uint8_t type = reader.getByte();
+        string id = reader.getString();
+        string name = reader.getString();
+        string category = reader.getString();
+        int oldQuantity = reader.getInt32();
+        int newQuantity = reader.getInt32();
+        double newPrice = reader.getDouble();
+        if (!reader.ok || (int) w >= warehouses.size()) return;
+
+        // Rejected rather than cut to fit: a shortened ID could collide with another item
+        string reason;
+        if (type == ChangeEvent::Added && !Item::checkFields(id, name, category, newPrice, reason)) {
+            reader.fail(reason);
+            return;
+        }
+        if (type == ChangeEvent::Updated && !validPrice(newPrice)) {
+            reader.fail("Price of item " + id + " is not a valid price");
+            return;
+        }
 
-        do {
-            cout << "[Back - 0]\n";
-            cout << "Input ID: ";
-            cin >> id;
+        Inventory &inventory = warehouses.inventory(w);
+        int position = inventory.findItemIndex(id);
+        if (type == ChangeEvent::Added) {
+            if (position == -1) inventory.insertItem(Item(id, name, newQuantity, newPrice, category));
+        } else if (type == ChangeEvent::Removed) {
+            if (position != -1) inventory.eraseItemAt(position);
+        } else if (position != -1) {
+            if (newQuantity != oldQuantity) inventory.adjustQuantity(id, newQuantity - oldQuantity, false);
+            if (toCents(newPrice) != inventory.items[position].getPriceCents()) {
+                inventory.setItemPrice(position, newPrice);
+            }
+        }
+    }
 
-            if (id == "0") return;  // Exit to main menu if "0" is entered
+    // Handles one frame from the primary; returns false if it could not be read
+    bool applyFrame(const string& payload) {
+        RecordReader reader(payload.data(), payload.size());
+        uint8_t type = reader.getByte();
+        uint64_t seq = reader.getUint64();
+        if (!reader.ok) return false;
 
-            // Searching for the item with the given ID
-            for (int i = 0; i < itemCount; i++) {
-                if (items[i].getId() == id) {
-                    itemFound = true;
-                    cout << items[i].getName() << " has been removed from the inventory.\n";
-
-                    // Shift all items after the found item to fill the gap
-                    for (int j = i; j < itemCount - 1; j++) {
-                        items[j] = items[j + 1];
-                    }
-                    itemCount--;  // Decrease item count after removal
-                    break;
-                }
-            }
+        lastHeardMs = nowMs();
+        if (seq > primarySequence) primarySequence = seq;
+        if (type == 'H') return true;
 
-            if (!itemFound) {
-                cout << "Item not found!\n";
+        {
+            lock_guard<mutex> lock(inventoryMutex);
+            if (type == 'S') {
+                applySnapshot(reader);
+            } else if (type == 'C') {
+                applyChange(reader);
             }
+        }
+        if (!reader.ok) {
+            if (!reader.error.empty()) failure = reader.error;
+            return false;
+        }
+        appliedSequence = seq;
+        return true;
+    }
 
-            // Check if the inventory is now empty
-            if (itemCount == 0) {
-                cout << "Inventory is empty. Returning to main menu...\n";
-                return; // Exit to main menu if inventory is empty
-            }
+    void run() {
+        string payload;
+        while (receiveFrame(fd, payload) && applyFrame(payload)) {
+            if (payload[0] == 'H') continue;
 
-            // Ask if the user wants to remove another item
-            cout << "Remove another item? [Y/N]: ";
-            cin >> choice;
+            RecordWriter ack;
+            ack.putByte('A');
+            ack.putUint64(appliedSequence);
+            if (!sendFrame(fd, ack.buffer)) break;
+        }
+        connected = false;
+    }
 
-        } while (tolower(choice) == 'y');
+public:
+    ReplicationReplica(PartitionedInventory& inventories, mutex& lock, const string& path)
+            : warehouses(inventories), inventoryMutex(lock), socketPath(path) {}
+
+    ~ReplicationReplica() {
+        if (fd != -1) shutdown(fd, SHUT_RDWR);  // Wakes the receiver
+        if (receiver.joinable()) receiver.join();
+        if (fd != -1) close(fd);
     }
 
-    // Method to display items by category
-    void displayItemsByCategory() override {
-        if (itemCount == 0) {
-            cout << "Please add items first!\n";
-            return;
+    // Connects to the primary and loads its snapshot; returns false if there is no primary
+    bool connect() {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path)) return false;
+        strcpy(address.sun_path, socketPath.c_str());
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1) return false;
+        if (::connect(fd, (sockaddr*) &address, sizeof(address)) == -1) {
+            close(fd);
+            fd = -1;
+            return false;
         }
 
-        string categoryChoice;
-        bool categoryFound = false;
+        string payload;
+        if (!receiveFrame(fd, payload) || payload.empty() || payload[0] != 'S' || !applyFrame(payload)) {
+            return false;
+        }
+        connected = true;
+        receiver = thread(&ReplicationReplica::run, this);
+        return true;
+    }
 
-        while (true) {
-            cout << "[Back - 0]\n";
-            cout << "Input Category (Clothing, Electronics, Entertainment): ";
-            cin >> categoryChoice;
+    // Why the primary's data was rejected ("" if it was not)
+    const string& failureReason() const { return failure; }
 
-            // Check for back option
-            if (categoryChoice == "0") {
-                return; // Return to main menu if input is '0'
-            }
+    // Method to display the replication state for the stats screen
+    void displayStatus() const {
+        cout << "Replication: replica of " << socketPath << (connected ? "" : " (disconnected)")
+             << ", applied " << appliedSequence << " of " << primarySequence
+             << ", lag " << primarySequence - appliedSequence << " change(s), last heard from primary "
+             << nowMs() - lastHeardMs << " ms ago\n";
+        if (!connected && !failure.empty()) cout << "Stopped at a change from the primary: " << failure << ".\n";
+    }
+};
 
-            // Convert to lowercase for case-insensitive comparison
-            for (auto &c : categoryChoice) c = tolower(c);
+// One-shot command mode for scripts, e.g.
+//   midterm_project_oop get <ID>
+//   midterm_project_oop low-stock [--threshold N]
+//   midterm_project_oop filter "category = electronics and quantity < 10"
+//   midterm_project_oop summary
+//   midterm_project_oop export csv|jsonl [FILTER] [--output FILE [--shards N]]
+// "--warehouse <name>" limits the command to one warehouse. The saved items are decoded
+// straight from the memory-mapped store files, without building any of the interactive
+// indexes, so the answer costs one pass over the data. Exits with 0 on success, 1 if nothing
+// matched and 2 on a usage error.
+int runCommand(int argc, char* argv[]) {
+    vector<string> operands;
+    string warehouseName, outputPath;
+    int threshold = Inventory::LOW_STOCK_THRESHOLD;
+    int shards = 1;
 
-            // Validate the category
-            if (categoryChoice != "clothing" && categoryChoice != "electronics" && categoryChoice != "entertainment") {
-                cout << "Invalid category! Please enter a valid category.\n";
-            } else {
-                break; // Valid category, exit the loop
+    for (int a = 1; a < argc; a++) {
+        string arg = argv[a];
+        if (arg == "--warehouse" && a + 1 < argc) {
+            warehouseName = argv[++a];
+        } else if (arg == "--output" && a + 1 < argc) {
+            outputPath = argv[++a];
+        } else if ((arg == "--threshold" || arg == "--shards") && a + 1 < argc) {
+            string_view value = argv[++a];
+            int &number = (arg == "--threshold") ? threshold : shards;
+            auto result = from_chars(value.data(), value.data() + value.size(), number);
+            if (result.ec != errc() || result.ptr != value.data() + value.size()) {
+                cerr << "'" << value << "' after " << arg << " is not a whole number.\n";
+                return 2;
             }
+        } else {
+            operands.push_back(arg);
         }
+    }
 
-        // Display items in the chosen category
-        cout << "ID        ITEM           QTY     PRICE   \n";
-        cout << "-----------------------------------------\n";
-        bool itemsExist = false;
-        for (int i = 0; i < itemCount; i++) {
-            if (items[i].getCategory() == categoryChoice) {
-                categoryFound = true;
-                itemsExist = true;
-                cout << left << setw(10) << items[i].getId()
-                     << setw(15) << items[i].getName()
-                     << setw(8) << items[i].getQuantity()
-                     << setw(8) << items[i].getPrice() << endl;
-            }
+    string command = operands.empty() ? "" : operands[0];
+    ItemFilter filter;
+    string error;
+    if (command == "get" && operands.size() == 2) {
+        filter.clauses.push_back({{ItemFilter::Id, ItemFilter::Equal, 0, operands[1]}});
+    } else if (command == "low-stock" && operands.size() == 1) {
+        filter = ItemFilter::where(ItemFilter::Quantity, ItemFilter::LessEqual, threshold);
+    } else if ((command == "filter" && operands.size() == 2) ||
+               (command == "export" && operands.size() == 3)) {
+        if (!ItemFilter::parse(operands.back(), filter, error)) {
+            cerr << error << ".\n";
+            return 2;
         }
+    } else if (!(command == "summary" && operands.size() == 1) && !(command == "export" && operands.size() == 2)) {
+        cerr << "Usage: " << argv[0] << " [--warehouse NAME] get ID | low-stock [--threshold N] | "
+             << "filter EXPRESSION | summary | export csv|jsonl [FILTER] [--output FILE [--shards N]]\n";
+        return 2;
+    }
 
-        if (!itemsExist) {
-            cout << "No items available in this category.\n";
-        }
+    vector<string> names = loadWarehouseNames("warehouses.txt");
+    bool exporting = command == "export";
+    if (exporting && operands[1] != "csv" && operands[1] != "jsonl") {
+        cerr << "Export format must be csv or jsonl.\n";
+        return 2;
+    }
+    if (shards > 1 && outputPath.empty()) {
+        cerr << "--shards needs --output to name the files.\n";
+        return 2;
+    }
+    if (shards < 1 || shards > maxExportShards()) {
+        cerr << "--shards must be between 1 and " << maxExportShards() << ".\n";
+        return 2;
     }
 
-    // Method to display all items in a formatted table
-    void displayAllItems() override {
-        if (itemCount == 0) {
-            cout << "Please add items first!\n";
-            return;
+    vector<vector<Item>> loaded(names.size());  // Exported rows point into these
+    vector<ExportRow> rows;
+    vector<PartitionedInventory::Located> found;
+    StockTotals totals;
+    bool warehouseFound = false;
+
+    for (int w = 0; w < (int) names.size(); w++) {
+        if (!warehouseName.empty() && strcasecmp(names[w].c_str(), warehouseName.c_str()) != 0) continue;
+        warehouseFound = true;
+
+        CheckpointStore store(PartitionedInventory::storePath("inventory", names, w));
+        vector<Item> &items = loaded[w];
+#if defined(INVENTORY_STORAGE_MAPPED)
+        // The item file is the live copy; the checkpoints only count while there is none
+        if (!MappedItemFile::read(store.itemFilePath(), items)) {
+            if (access(store.itemFilePath().c_str(), F_OK) == 0) {
+                cerr << store.itemFilePath() << " cannot be used. Reading the checkpoints instead.\n";
+            }
+            items = store.load();
         }
+#else
+        items = store.load();
+#endif
 
-        cout << "ID        ITEM           QTY     PRICE   CATEGORY\n";
-        cout << "-------------------------------------------------\n";
-        for (int i = 0; i < itemCount; i++) {
-            cout << left << setw(10) << items[i].getId()
-                 << setw(15) << items[i].getName()
-                 << setw(8) << items[i].getQuantity()
-                 << setw(8) << items[i].getPrice()
-                 << setw(10) << items[i].getCategory() << endl;
+        if (command == "summary") {
+            for (auto &item : items) totals.apply(item, 1);
+        } else if (exporting && filter.clauses.empty()) {
+            for (auto &item : items) rows.push_back({&item, names[w]});
+        } else if (exporting) {
+            for (int i : filter.select(items.data(), items.size())) rows.push_back({&items[i], names[w]});
+        } else {
+            for (int i : filter.select(items.data(), items.size())) found.push_back({w, items[i]});
         }
     }
 
-    // Method to search for an item by ID
-    void searchItem() override {
-        if (itemCount == 0) {
-            cout << "Please add items first!\n";
-            return;
-        }
+    if (!warehouseFound) {
+        cerr << "Unknown warehouse '" << warehouseName << "'.\n";
+        return 2;
+    }
 
-        string id;
-        bool itemFound;
-        char choice;
+    if (exporting) {
+        ItemExporter::Format format = (operands[1] == "csv") ? ItemExporter::Csv : ItemExporter::JsonLines;
+        bool withWarehouse = names.size() > 1 && warehouseName.empty();
+        bool written;
 
-        do {
-            itemFound = false; // Reset itemFound for each search attempt
+        if (shards > 1) {
+            written = exportToShards(rows, format, withWarehouse, outputPath, shards);
+        } else {
+            int fd = outputPath.empty() ? STDOUT_FILENO : ::open(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            written = fd != -1 && exportOrdered(rows, format, withWarehouse, fd);
+            if (fd != -1 && fd != STDOUT_FILENO) ::close(fd);
+        }
 
-            cout << "[Back - 0]\n";
-            cout << "Input ID: ";
-            cin >> id;
+        if (!written) {
+            cerr << "Writing the export failed.\n";
+            return 2;
+        }
+        return 0;
+    }
+    if (command == "summary") {
+        cout << "Items: " << totals.itemCount << "\n";
+        cout << "Units: " << totals.totalUnits << "\n";
+        cout << "Value: " << formatCents(totals.totalValue) << "\n";
+        return 0;
+    }
+    if (found.empty()) {
+        cout << "No items found.\n";
+        return 1;
+    }
 
-            if (id == "0") return;  // Exit to main menu if "0" is entered
+    // The warehouse column only appears when there is more than one warehouse
+    bool showWarehouse = names.size() > 1;
+    if (showWarehouse) cout << "WAREHOUSE      ";
+    cout << "ID        ITEM           QTY     PRICE   CATEGORY\n";
+    for (auto &entry : found) {
+        if (showWarehouse) cout << left << setw(15) << names[entry.warehouse];
+        cout << left << setw(10) << entry.item.getId()
+             << setw(15) << entry.item.getName()
+             << setw(8) << entry.item.getQuantity()
+             << setw(8) << entry.item.getPrice()
+             << entry.item.getCategory() << endl;
+    }
+    return 0;
+}
 
-            // Searching for the item with the given ID
-            for (int i = 0; i < itemCount; i++) {
-                if (items[i].getId() == id) {
-                    itemFound = true;
-
-                    // Display item in table format
-                    cout << "Item found:\n";
-                    cout << "---------------------------------------------------\n";
-                    cout << left << setw(10) << "ID"
-                         << left << setw(20) << "Name"
-                         << left << setw(10) << "Quantity"
-                         << left << setw(10) << "Price" << endl;
-                    cout << "---------------------------------------------------\n";
-                    cout << left << setw(10) << items[i].getId()
-                         << left << setw(20) << items[i].getName()
-                         << left << setw(10) << items[i].getQuantity()
-                         << left << setw(10) << items[i].getPrice() << endl;
-                    cout << "---------------------------------------------------\n";
-                    break;
-                }
-            }
+#if INVENTORY_BENCHMARK
 
-            if (!itemFound) {
-                cout << "Item not found!\n";
-            }
+// Benchmarks for the opt-in inventory_bench target (cmake -DINVENTORY_BENCHMARKS=ON). Each
+// one builds its data in memory, times only the operation under test and prints a table.
 
-            // Ask the user if they want to search again and validate input
-            do {
-                cout << "Search item again? [Y/N]: ";
-                cin >> choice;
-                choice = tolower(choice); // Convert input to lowercase for easier validation
-            } while (choice != 'y' && choice != 'n'); // Repeat until 'y' or 'n' is entered
+// Wall-clock seconds taken by action
+template<typename Action>
+double secondsTaken(Action action) {
+    auto start = chrono::steady_clock::now();
+    action();
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
 
-        } while (choice == 'y'); // Continue searching if 'Y' or 'y' is entered
+// Items with random 12-letter names, quantities and prices (the same ones on every run)
+vector<Item> benchmarkItems(int count) {
+    mt19937_64 random(42);
+    vector<Item> items;
+    items.reserve(count);
+    for (int i = 0; i < count; i++) {
+        string name(12, 'a');
+        for (auto &c : name) c = 'a' + random() % 26;
+        items.emplace_back("B" + to_string(i), name, random() % 1000, (random() % 100000) / 100.0, "general");
     }
+    return items;
+}
 
-    // Method to sort items using Bubble Sort
-    void sortItems() override {
-        if (itemCount == 0) {
-            cout << "Please add items first!\n";
-            return;
-        }
+// Sorts the items by name with 1, 4 and 16 threads, best of three runs each
+void benchmarkSort(int count) {
+    vector<Item> source = benchmarkItems(count);
+    BasicInventory<GrowableItemVector> inventory;
+    inventory.items.reserve(count);
+    inventory.itemCount = count;
 
-        string sortChoice;
-        char orderChoice;
+    cout << "Sorting " << count << " items by name (" << thread::hardware_concurrency() << " hardware thread(s))\n";
+    cout << "THREADS   SECONDS   SPEEDUP\n";
+    double single = 0;
+    for (int threads : {1, 4, 16}) {
+        double best = numeric_limits<double>::max();
+        for (int run = 0; run < 3; run++) {
+            copy(source.begin(), source.end(), inventory.items.data());
+            best = min(best, secondsTaken([&]() {
+                withItemOrder("name", true, [&](auto order) { inventory.parallelSort(order, threads); });
+            }));
+        }
+        if (threads == 1) single = best;
+        cout << left << setw(10) << threads << setw(10) << fixed << setprecision(3) << best
+             << setprecision(2) << single / best << "x\n";
+    }
+}
 
-        // Display back option
-        cout << "[Back - 0]\n";
+// Sells and restocks single units of items picked from a Zipfian distribution (a few hot items
+// take most of the traffic) with 1, 4 and 16 threads, then checks that the quantities, the
+// quantity index and the totals agree. Returns false if they do not.
+bool benchmarkAdjust(int count) {
+    const int OPERATIONS = 400000;  // Per run, split between the threads
+    vector<Item> source = benchmarkItems(count);
+    vector<string> ids;
+    long long initialUnits = 0;
+    for (auto &item : source) {
+        ids.push_back(string(item.getId()));
+        initialUnits += item.getQuantity();
+    }
 
-        // Ask the user for sorting criteria (Name, Price, Quantity)
-        while (true) {
-            cout << "Sort by [Name/Price/Quantity]: ";
-            cin >> sortChoice;
-            if (sortChoice == "0") return; // Return to main menu if input is '0'
+    // Cumulative distribution of item popularity, Zipf's law with s = 0.99
+    vector<double> popularity(count);
+    double sum = 0;
+    for (int i = 0; i < count; i++) popularity[i] = (sum += 1 / pow(i + 1, 0.99));
+    for (auto &p : popularity) p /= sum;
 
-            for (auto &c : sortChoice) c = tolower(c);  // Convert to lowercase for case-insensitive comparison
+    cout << "Adjusting " << count << " items, Zipfian hot set, " << OPERATIONS << " operations per run ("
+         << thread::hardware_concurrency() << " hardware thread(s))\n";
+    cout << "THREADS   SECONDS   OPS/SEC     CONSISTENT\n";
+    bool allConsistent = true;
+    for (int threads : {1, 4, 16}) {
+        BasicInventory<GrowableItemVector> inventory;
+        for (auto &item : source) inventory.insertItem(item);
 
-            if (sortChoice == "name" || sortChoice == "price" || sortChoice == "quantity") {
-                break; // Valid input, exit loop
-            } else {
-                cout << "Invalid choice! Please enter 'Name', 'Price', or 'Quantity'.\n";
+        atomic<long long> netDelta{0};
+        double seconds = secondsTaken([&]() {
+            vector<thread> workers;
+            for (int t = 0; t < threads; t++) {
+                workers.emplace_back([&, t]() {
+                    mt19937_64 random(t + 1);
+                    uniform_real_distribution<double> uniform(0, 1);
+                    long long applied = 0;
+                    for (int op = 0; op < OPERATIONS / threads; op++) {
+                        size_t position = lower_bound(popularity.begin(), popularity.end(), uniform(random)) - popularity.begin();
+                        int delta = (random() % 2 == 0) ? 1 : -1;
+                        auto result = inventory.adjustQuantity(ids[min<size_t>(position, count - 1)], delta);
+                        if (result == BasicInventory<GrowableItemVector>::AdjustResult::Applied) applied += delta;
+                    }
+                    netDelta += applied;
+                });
             }
+            for (auto &worker : workers) worker.join();
+        });
+
+        long long units = 0;
+        for (int i = 0; i < inventory.itemCount; i++) units += inventory.items[i].getQuantity();
+        auto indexed = inventory.quantityIndex.firstPage(inventory.itemCount + 1);
+        bool consistent = units == initialUnits + netDelta && units == inventory.totals.totalUnits &&
+                          (int) indexed.size() == inventory.itemCount;
+        for (auto &entry : indexed) {
+            if (inventory.items[inventory.findItemIndex(entry.second)].getQuantity() != entry.first) consistent = false;
         }
+        allConsistent = allConsistent && consistent;
 
-        // Ask the user for sorting order (Ascending or Descending)
-        while (true) {
-            cout << "Sort in [A-Ascending/D-Descending]: ";
-            cin >> orderChoice;
-            if (orderChoice == '0') return; // Return to main menu if input is '0'
+        cout << left << setw(10) << threads << setw(10) << fixed << setprecision(3) << seconds
+             << setw(12) << setprecision(0) << OPERATIONS / seconds << (consistent ? "yes" : "NO") << "\n";
+    }
+    return allConsistent;
+}
 
-            orderChoice = tolower(orderChoice);  // Convert input to lowercase for easier validation
-            if (orderChoice == 'a' || orderChoice == 'd') {
-                break; // Valid input, exit loop
-            } else {
-                cout << "Invalid choice! Please enter 'A' for Ascending or 'D' for Descending.\n";
-            }
-        }
+// Reads the same scripted menu input (a choice, category, ID, name, quantity, price and a Y/N
+// answer per line) from standard input through InputReader and through cin, which the menus
+// used before it. Standard input is pointed at a temporary file for this.
+void benchmarkInput(int lines) {
+    string text;
+    mt19937_64 random(42);
+    for (int i = 0; i < lines; i++) {
+        text += "1 Tools B" + to_string(i) + " Widget" + to_string(random() % 1000) + " " +
+                to_string(random() % 1000) + " " + to_string(random() % 100000 / 100.0) + " N\n";
+    }
 
-        // Bubble Sort implementation
-        for (int i = 0; i < itemCount - 1; i++) {
-            for (int j = 0; j < itemCount - i - 1; j++) {
-                bool swapNeeded = false;
-                if (sortChoice == "name") {
-                    swapNeeded = (orderChoice == 'a') ?
-                                 (items[j].getName() > items[j + 1].getName()) :
-                                 (items[j].getName() < items[j + 1].getName());
-                } else if (sortChoice == "price") {
-                    swapNeeded = (orderChoice == 'a') ?
-                                 (items[j].getPrice() > items[j + 1].getPrice()) :
-                                 (items[j].getPrice() < items[j + 1].getPrice());
-                } else if (sortChoice == "quantity") {
-                    swapNeeded = (orderChoice == 'a') ?
-                                 (items[j].getQuantity() > items[j + 1].getQuantity()) :
-                                 (items[j].getQuantity() < items[j + 1].getQuantity());
-                }
+    char path[] = "/tmp/inventory_bench_XXXXXX";
+    int fd = mkstemp(path);
+    size_t written = 0;
+    while (fd != -1 && written < text.size()) {
+        ssize_t n = ::write(fd, text.data() + written, text.size() - written);
+        if (n <= 0) break;
+        written += n;
+    }
+    if (written < text.size()) {
+        cerr << "Cannot write the input file.\n";
+        return;
+    }
+    unlink(path);
+    dup2(fd, 0);
+
+    auto readAll = [](auto& reader) {
+        int choice, quantity;
+        string category, id, name;
+        double price;
+        char answer;
+        long long records = 0;
+        while (reader >> choice >> category >> id >> name >> quantity >> price >> answer) records++;
+        return records;
+    };
 
-                // Swap items if needed
-                if (swapNeeded) {
-                    swap(items[j], items[j + 1]);
+    cout << "Reading " << lines << " lines (" << fixed << setprecision(1) << text.size() / 1e6 << " MB) of menu input\n";
+    cout << "READER        SECONDS   MB/SEC    LINES\n";
+    for (string reader : {"InputReader", "cin"}) {
+        double best = numeric_limits<double>::max();
+        long long records = 0;
+        for (int run = 0; run < 3; run++) {
+            lseek(0, 0, SEEK_SET);
+            best = min(best, secondsTaken([&]() {
+                if (reader == "cin") {
+                    records = readAll(cin);
+                    cin.clear();
+                    clearerr(stdin);
+                } else {
+                    InputReader fresh;
+                    records = readAll(fresh);
                 }
-            }
+            }));
         }
+        cout << left << setw(14) << reader << setw(10) << fixed << setprecision(3) << best
+             << setw(10) << setprecision(1) << text.size() / 1e6 / best << records << "\n";
+    }
+}
 
-        // Display sorted items in table format
-        cout << "Items sorted by " << sortChoice << " in "
-             << ((orderChoice == 'a') ? "Ascending" : "Descending") << " order:\n";
-        cout << "---------------------------------------------------\n";
-        cout << left << setw(10) << "ID"
-             << left << setw(20) << "Name"
-             << left << setw(10) << "Quantity"
-             << left << setw(10) << "Price" << endl;
-        cout << "---------------------------------------------------\n";
-        for (int i = 0; i < itemCount; i++) {
-            cout << left << setw(10) << items[i].getId()
-                 << left << setw(20) << items[i].getName()
-                 << left << setw(10) << items[i].getQuantity()
-                 << left << setw(10) << items[i].getPrice() << endl;
+// Times one-shot commands (runCommand(), as called for "midterm_project_oop get ID" and so on)
+// against a store of the given size written to a temporary directory. The files are in the
+// page cache and process start-up is not included, so this is the time from main() to the
+// answer; output goes to /dev/null. Both the snapshot and the item file are written, so each
+// storage build reads what it would read in production.
+void benchmarkCommand(int count) {
+    char directory[] = "/tmp/inventory_bench_XXXXXX";
+    if (mkdtemp(directory) == nullptr || chdir(directory) != 0) {
+        cerr << "Cannot create a temporary directory.\n";
+        return;
+    }
+    {
+        vector<Item> items = benchmarkItems(count);
+        CheckpointStore store("inventory");
+        store.writeSnapshotAsync(items);
+        store.waitForBackgroundWriter();
+
+        MappedItemFile itemFile;
+        bool created;
+        if (itemFile.open(store.itemFilePath(), created) != -1 && itemFile.reserve(count)) {
+            copy(items.begin(), items.end(), itemFile.data());
+            itemFile.setCount(count);
         }
-        cout << "---------------------------------------------------\n";
     }
 
-    // Method to display items that are low in stock (quantity <= 5)
-    void displayLowStockItems() override {
-        if (itemCount == 0) {
-            cout << "Please add items first!\n";
-            return;
+    string middleId = "B" + to_string(count / 2);
+    vector<vector<string>> commands = {{"get", middleId}, {"low-stock"}, {"summary"}};
+    ofstream devNull("/dev/null");
+
+    cout << "One-shot commands on " << count << " stored items\n";
+    cout << "COMMAND        BEST MS   MEDIAN MS\n";
+    for (auto &command : commands) {
+        vector<char*> argv = {(char*) "inventory_bench"};
+        for (auto &arg : command) argv.push_back(arg.data());
+
+        vector<double> runs;
+        for (int run = 0; run < 7; run++) {
+            streambuf *console = cout.rdbuf(devNull.rdbuf());
+            runs.push_back(secondsTaken([&]() { runCommand(argv.size(), argv.data()); }) * 1000);
+            cout.rdbuf(console);
         }
+        sort(runs.begin(), runs.end());
+        cout << left << setw(15) << command[0] << setw(10) << fixed << setprecision(2) << runs.front()
+             << runs[runs.size() / 2] << "\n";
+    }
 
-        bool lowStockFound = false;
+    remove("inventory.snap");
+    remove("inventory.items");
+    if (chdir("/tmp") == 0) rmdir(directory);
+}
 
-        cout << "Low stock items (Quantity <= 5):\n";
-        cout << "ID        ITEM           QTY     PRICE   CATEGORY\n";
-        cout << "-------------------------------------------------\n";
+// Fills an inventory with the given storage layout, then times a scan over the records, a
+// round of single-unit sales through the ID index and a sort by price
+template<ItemStorage Storage>
+void benchmarkLayout(const string& layout, const vector<Item>& source) {
+    BasicInventory<Storage> inventory;
+    double fill = secondsTaken([&]() {
+        for (auto &item : source) {
+            if (!inventory.insertItem(item)) break;  // The fixed array is full
+        }
+    });
 
-        for (int i = 0; i < itemCount; i++) {
-            if (items[i].getQuantity() <= 5) {
-                lowStockFound = true;
-                cout << left << setw(10) << items[i].getId()
-                     << setw(15) << items[i].getName()
-                     << setw(8) << items[i].getQuantity()
-                     << setw(8) << items[i].getPrice()
-                     << setw(10) << items[i].getCategory() << endl;
+    int count = inventory.itemCount;
+    vector<string> ids;
+    for (int i = 0; i < count; i++) ids.push_back(string(inventory.items[i].getId()));
+
+    volatile long long value;  // Keeps the scan from being optimized away
+    double scan = secondsTaken([&]() {
+        for (int round = 0; round < 100; round++) {
+            long long sum = 0;
+            for (int i = 0; i < inventory.itemCount; i++) {
+                sum += inventory.items[i].getQuantity() * inventory.items[i].getPriceCents();
             }
+            value = sum;
         }
+    });
 
-        if (!lowStockFound) {
-            cout << "No low stock items.\n";
+    double adjust = secondsTaken([&]() {
+        for (auto &id : ids) inventory.adjustQuantity(id, 1);
+    });
+
+    double sort = secondsTaken([&]() {
+        withItemOrder("price", true, [&](auto order) { inventory.parallelSort(order); });
+    });
+
+    cout << left << setw(10) << layout << setw(10) << count << fixed << setprecision(2)
+         << setw(10) << fill * 1000 << setw(12) << scan * 1e9 / (100.0 * max(count, 1))
+         << setw(12) << adjust * 1e9 / max(count, 1) << sort * 1000 << "\n";
+}
+
+// Compares the storage layouts: the fixed array at its 100 items, then the growable vector
+// and the mapped file (an anonymous mapping, as before a file is opened) at the full size
+void benchmarkStorage(int count) {
+    vector<Item> source = benchmarkItems(count);
+
+    cout << "Storage layouts with " << count << " items (the fixed array holds 100)\n";
+    cout << "LAYOUT    ITEMS     FILL MS   SCAN NS/ITEM ADJUST NS   SORT MS\n";
+    benchmarkLayout<FixedItemArray<100>>("fixed", source);
+    benchmarkLayout<GrowableItemVector>("vector", source);
+    benchmarkLayout<MappedItemFile>("mapped", source);
+}
+
+// inventory_bench BENCHMARK [SIZE]
+int main(int argc, char* argv[]) {
+    string benchmark = argc > 1 ? argv[1] : "";
+    int size = 0;
+    if (argc > 2 && (!parseQuantity(argv[2], size) || size == 0)) {
+        cerr << "'" << argv[2] << "' is not a positive whole number.\n";
+        return 2;
+    }
+
+    if (benchmark == "sort") {
+        benchmarkSort(size > 0 ? size : 1000000);
+    } else if (benchmark == "adjust") {
+        if (!benchmarkAdjust(size > 0 ? size : 10000)) return 1;
+    } else if (benchmark == "input") {
+        benchmarkInput(size > 0 ? size : 1000000);
+    } else if (benchmark == "command") {
+        benchmarkCommand(size > 0 ? size : 1000000);
+    } else if (benchmark == "storage") {
+        benchmarkStorage(size > 0 ? size : 100000);
+    } else {
+        cerr << "Usage: inventory_bench sort|adjust|command|storage [ITEMS] | input [LINES]\n";
+        return 2;
+    }
+    return 0;
+}
+
+#else
+
+int main(int argc, char* argv[]) {
+    categories.load("categories.txt");
+
+    // Any other argument is a one-shot command for scripts
+    if (argc > 1 && string(argv[1]) != "--replica") return runCommand(argc, argv);
+
+    // Started with --replica, this process is a read-only copy of the primary running in the
+    // same directory; otherwise it is the primary and accepts replicas on the socket
+    bool replicaMode = argc > 1 && string(argv[1]) == "--replica";
+    const string socketPath = "inventory.sock";
+
+    PartitionedInventory warehouses;
+    mutex inventoryMutex;  // Held while a menu command runs, except while it waits for input
+    unique_ptr<ReplicationPrimary> primary;
+    unique_ptr<ReplicationReplica> replica;
+
+    if (replicaMode) {
+        replica.reset(new ReplicationReplica(warehouses, inventoryMutex, socketPath));
+        if (!replica->connect()) {
+            if (replica->failureReason().empty()) cout << "No primary is running on " << socketPath << ".\n";
+            else cout << "The primary's snapshot was rejected: " << replica->failureReason() << ".\n";
+            return 1;
         }
+        cout << "Connected to the primary. This replica is read-only.\n";
+    } else {
+        warehouses.open(loadWarehouseNames("warehouses.txt"), "inventory");
     }
-};
 
-int main() {
-    Inventory inventory;
+    int current = 0;  // Warehouse the menu operates on
     int choice;
 
+    // Low stock alerts are pushed by each warehouse the moment a change crosses the threshold
+    // (on a replica that includes changes shipped from the primary, hence the lock)
+    vector<ChangeFeed::Subscription*> lowStockAlerts;
+    {
+        lock_guard<mutex> lock(inventoryMutex);
+        for (int w = 0; w < warehouses.size(); w++) {
+            lowStockAlerts.push_back(warehouses.inventory(w).changeFeed.subscribe(
+                    ChangeFeed::BelowThreshold, "", Inventory::LOW_STOCK_THRESHOLD));
+        }
+    }
+
+    if (!replicaMode) {
+        primary.reset(new ReplicationPrimary(warehouses, inventoryMutex, socketPath));
+        if (!primary->start()) {
+            cout << "Replication is unavailable: cannot listen on " << socketPath << ".\n";
+            primary.reset();
+        }
+    }
+
     // Main menu loop
     do {
-        cout << "\nInventory Management System\n";
+        Inventory &inventory = warehouses.inventory(current);
+
+        cout << "\nInventory Management System";
+        if (warehouses.size() > 1) cout << " - " << warehouses.name(current);
+        cout << "\n";
         cout << "1 - Add Item\n";
         cout << "2 - Update Item\n";
         cout << "3 - Remove Item\n";
@@ -543,16 +5818,47 @@ int main() {
         cout << "6 - Search Item\n";
         cout << "7 - Sort Items\n";
         cout << "8 - Display Low Stock Items\n";
+        cout << "10 - Fuzzy Search by Name\n";
+        cout << "11 - Range Query by Price/Quantity\n";
+        cout << "12 - Inventory Summary\n";
+        cout << "13 - Top/Bottom Items\n";
+        cout << "14 - Browse Items (Paged)\n";
+        cout << "15 - Sell/Restock Item\n";
+        cout << "16 - Receive Shipment (Batch Update)\n";
+        cout << "17 - Save Changes\n";
+        cout << "18 - Save Full Snapshot\n";
+        cout << "19 - Switch Warehouse\n";
+        cout << "20 - All Warehouses Report\n";
+        cout << "21 - Filter Items\n";
+        cout << "22 - Export Items (CSV/JSON)\n";
+        cout << "23 - Import Items (CSV)\n";
+        cout << "24 - ID Filter Settings\n";
+        cout << "25 - Storage Sync Settings\n";
         cout << "9 - Exit\n";
         cout << "Enter choice: ";
 
         // Input validation for choice
-        while (!(cin >> choice)) {
-            cout << "Invalid input! Please enter a number from 1 to 9: ";
-            cin.clear(); // Clear the error flag
-            cin.ignore(numeric_limits<streamsize>::max(), '\n'); // Ignore the invalid input
+        while (!(input >> choice)) {
+            // Piped input that runs out exits (and saves) instead of asking forever
+            if (input.eof()) {
+                choice = 9;
+                break;
+            }
+            cout << "Invalid input! Please enter a number from 1 to 25: ";
+            input.clear(); // Clear the error flag
+            input.ignoreLine(); // Ignore the invalid input
+        }
+
+        // A replica only serves queries; its items change through the primary
+        if (replicaMode && (choice == 1 || choice == 2 || choice == 3 || (choice >= 15 && choice <= 18) || choice == 23)) {
+            cout << "This is a read-only replica. Make changes on the primary.\n";
+            continue;
         }
 
+        // The command's data access happens under the lock, but it is released whenever the
+        // command waits at a prompt, so replication never waits for the user
+        unique_lock<mutex> lock(inventoryMutex);
+        input.releaseWhileWaiting(&lock);
         switch (choice) {
             case 1:
                 inventory.addItem();
@@ -578,15 +5884,85 @@ int main() {
             case 8:
                 inventory.displayLowStockItems();
                 break;
+            case 10:
+                inventory.fuzzySearchByName();
+                break;
+            case 11:
+                inventory.rangeQuery();
+                break;
+            case 12:
+                inventory.displaySummary();
+                if (primary) primary->displayStatus();
+                if (replica) replica->displayStatus();
+                break;
+            case 13:
+                inventory.displayTopItems();
+                break;
+            case 14:
+                inventory.browseItems();
+                break;
+            case 15:
+                inventory.adjustStock();
+                break;
+            case 16:
+                inventory.receiveShipment();
+                break;
+            case 17:
+                inventory.saveCheckpoint();
+                break;
+            case 18:
+                inventory.saveSnapshot();
+                break;
+            case 19:
+                for (int w = 0; w < warehouses.size(); w++) {
+                    cout << w + 1 << " - " << warehouses.name(w) << "\n";
+                }
+                cout << "Warehouse: ";
+                inventory.validateInput(current);
+                current = max(1, min(current, warehouses.size())) - 1;
+                break;
+            case 20:
+                warehouses.displayWarehouseReport();
+                break;
+            case 21:
+                inventory.filterItems();
+                break;
+            case 22:
+                inventory.exportItems();
+                break;
+            case 23:
+                inventory.importItems();
+                break;
+            case 24:
+                inventory.configureIdFilter();
+                break;
+            case 25:
+                inventory.configureStorageSync();
+                break;
             case 9:
+                if (!replicaMode) cout << warehouses.saveAll() << " changed item(s) saved.\n";
                 cout << "Exiting...\n";
                 break;
             default:
                 cout << "Invalid choice! Please enter a valid option.\n";
                 break;
         }
+        input.releaseWhileWaiting(nullptr);
+
+        // Show any low stock alerts raised by the last action
+        ChangeEvent alert;
+        for (int w = 0; w < warehouses.size(); w++) {
+            while (lowStockAlerts[w]->events.pop(alert)) {
+                cout << "Low stock alert: " << alert.name << " (" << alert.id << ") is down to "
+                     << alert.newQuantity;
+                if (warehouses.size() > 1) cout << " in " << warehouses.name(w);
+                cout << endl;
+            }
+        }
 
     } while (choice != 9);
 
     return 0;
 }
+
+#endif